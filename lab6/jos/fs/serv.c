@@ -201,16 +201,21 @@ serve_set_size(envid_t envid, struct Fsreq_set_size *req)
 }
 
 // Read at most ipc->read.req_n bytes from the current seek position
-// in ipc->read.req_fileid.  Return the bytes read from the file to
-// the caller in ipc->readRet, then update the seek position.  Returns
-// the number of bytes successfully read, or < 0 on error.
+// in ipc->read.req_fileid, and update the seek position.  Rather than
+// copying the data into ipc->readRet, add the block cache pages that
+// hold it to 'v', to be mapped read-only in the caller, and tell the
+// caller in ipc->readRet.ret_off where in the first page the data
+// starts.  A single read returns at most IPC_MAXPAGES pages' worth.
+// Returns the number of bytes successfully read, or < 0 on error.
 int
-serve_read(envid_t envid, union Fsipc *ipc)
+serve_read(envid_t envid, union Fsipc *ipc, struct IpcVec *v)
 {
 	struct Fsreq_read *req = &ipc->read;
 	struct Fsret_read *ret = &ipc->readRet;
-  int re, req_n;
+  int re, req_n, i;
   struct OpenFile *o;
+  off_t off;
+  char *blk;
 
 	if (debug)
 		cprintf("serve_read %08x %08x %08x\n", envid, req->req_fileid, req->req_n);
@@ -220,17 +225,36 @@ serve_read(envid_t envid, union Fsipc *ipc)
     return re;
   }
 
-  req_n = req->req_n;
-  // if read bytes size > ret->ret_buf's size
-  if(req_n > sizeof(ret->ret_buf)){
-    req_n = sizeof(ret->ret_buf);
+  off = o->o_fd->fd_offset;
+  if(off >= o->o_file->f_size){
+    req_n = 0;
+  }else{
+    req_n = MIN(req->req_n, o->o_file->f_size - off);
+  }
+  // no more than fits in one IPC's worth of pages
+  req_n = MIN(req_n, IPC_MAXPAGES * BLKSIZE - off % BLKSIZE);
+  // at or past the end of the file, where there may be no block
+  if(req_n <= 0){
+    v->iv_npages = 0;
+    ret->ret_off = 0;
+    return 0;
   }
 
-  if((re = file_read(o->o_file, ret->ret_buf, req_n, o->o_fd->fd_offset)) < 0){
-    return re;
-  }	
-  o->o_fd->fd_offset += re;
-  return re;
+  for(i = 0; i * BLKSIZE < off % BLKSIZE + req_n; i++){
+    if((re = file_get_block(o->o_file, off / BLKSIZE + i, &blk)) < 0){
+      return re;
+    }
+    // fault the block in, so that there is a page to send
+    (void) *(volatile char *)blk;
+    v->iv_pages[i].ip_va = blk;
+    v->iv_pages[i].ip_perm = PTE_P | PTE_U;
+  }
+  v->iv_npages = i;
+
+  // req and ret share the request page; done with req now
+  ret->ret_off = off % BLKSIZE;
+  o->o_fd->fd_offset += req_n;
+  return req_n;
 }
 
 
@@ -316,7 +340,7 @@ typedef int (*fshandler)(envid_t envid, union Fsipc *req);
 fshandler handlers[] = {
 	// Open is handled specially because it passes pages
 	/* [FSREQ_OPEN] =	(fshandler)serve_open, */
-	[FSREQ_READ] =		serve_read,
+	/* [FSREQ_READ] =	(fshandler)serve_read, */
 	[FSREQ_STAT] =		serve_stat,
 	[FSREQ_FLUSH] =		(fshandler)serve_flush,
 	[FSREQ_WRITE] =		(fshandler)serve_write,
@@ -330,10 +354,15 @@ serve(void)
 	uint32_t req, whom;
 	int perm, r;
 	void *pg;
+	struct IpcVec v;
+
+	// Requests come in one page at fsreq; replies may carry several.
+	v.iv_dstva = fsreq;
+	v.iv_dstnpages = 1;
 
+	perm = 0;
+	req = ipc_recv((int32_t *) &whom, fsreq, &perm);
 	while (1) {
-		perm = 0;
-		req = ipc_recv((int32_t *) &whom, fsreq, &perm);
 		if (debug)
 			cprintf("fs req %d from %08x [page %08x: %s]\n",
 				req, whom, uvpt[PGNUM(fsreq)], fsreq);
@@ -342,20 +371,31 @@ serve(void)
 		if (!(perm & PTE_P)) {
 			cprintf("Invalid request from %08x: no argument page\n",
 				whom);
+			perm = 0;
+			req = ipc_recv((int32_t *) &whom, fsreq, &perm);
 			continue; // just leave it hanging...
 		}
 
 		pg = NULL;
+		v.iv_npages = 0;
 		if (req == FSREQ_OPEN) {
 			r = serve_open(whom, (struct Fsreq_open*)fsreq, &pg, &perm);
+			if (pg) {
+				v.iv_pages[0].ip_va = pg;
+				v.iv_pages[0].ip_perm = perm;
+				v.iv_npages = 1;
+			}
+		} else if (req == FSREQ_READ) {
+			r = serve_read(whom, fsreq, &v);
 		} else if (req < ARRAY_SIZE(handlers) && handlers[req]) {
 			r = handlers[req](whom, fsreq);
 		} else {
 			cprintf("Invalid request code %d from %08x\n", req, whom);
 			r = -E_INVAL;
 		}
-		ipc_send(whom, r, pg, perm);
-		sys_page_unmap(0, fsreq);
+		// Reply and take the next request in one go.  The next
+		// request page replaces this one at fsreq.
+		req = ipc_reply_waitv(whom, r, &v, (int32_t *) &whom, &perm);
 	}
 }
 
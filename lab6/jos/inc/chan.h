@@ -0,0 +1,40 @@
+// Shared-memory channels: a single-producer, single-consumer ring of
+// fixed-size message slots in one page mapped by both environments.
+// Messages are copied in and out of the ring entirely at user level;
+// the kernel is only involved to put an idle consumer, or a producer
+// facing a full ring, to sleep (sys_chan_wait) and to wake it up
+// (sys_chan_notify).  The producer only needs to notify when the ring
+// goes from empty to non-empty, and the consumer only when the
+// producer has said it is waiting for room.
+
+#ifndef JOS_INC_CHAN_H
+#define JOS_INC_CHAN_H
+
+#include <inc/types.h>
+#include <inc/mmu.h>
+
+// Maximum number of channels in the system
+#define NCHAN		64
+
+// What sys_chan_wait waits for
+#define CHAN_WAIT_DATA	0	// Consumer: the ring is non-empty
+#define CHAN_WAIT_ROOM	1	// Producer: the ring is not full
+
+// The ring header.  The head and tail indices are free-running: the
+// ring is empty when they are equal, and slot 'i' lives at
+// cr_data[(i % cr_nslots) * cr_slotsize].  The kernel only ever reads
+// the header.  cr_head and cr_tail are kept on separate cache lines,
+// since each is written by a different environment.
+struct ChanRing {
+	volatile uint32_t cr_head;	// Next slot to consume; consumer only
+	uint8_t cr_pad1[60];
+	volatile uint32_t cr_tail;	// Next slot to produce; producer only
+	volatile uint32_t cr_waiting;	// Producer waits for room; producer only
+	uint8_t cr_pad2[56];
+	uint32_t cr_nslots;		// Number of slots, a power of two
+	uint32_t cr_slotsize;		// Bytes per slot
+	uint8_t cr_pad3[56];
+	uint8_t cr_data[PGSIZE - 192];
+};
+
+#endif	// !JOS_INC_CHAN_H
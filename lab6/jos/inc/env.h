@@ -38,6 +38,21 @@ enum {
 	ENV_NOT_RUNNABLE
 };
 
+// Scheduling policies (see kern/sched.h and sys_sched_set_policy).
+enum {
+	SCHED_RR = 0,		// Round-robin over all runnable environments
+	SCHED_PRIO,		// Multi-level feedback queues
+};
+
+// Scheduling priorities.  Higher priorities run first under the
+// SCHED_PRIO policy; the round-robin policy ignores them.
+enum {
+	ENV_PRIO_LOW = 0,
+	ENV_PRIO_NORMAL,
+	ENV_PRIO_HIGH,
+	NENVPRIO
+};
+
 // Special environment types
 enum EnvType {
 	ENV_TYPE_USER = 0,
@@ -45,6 +60,25 @@ enum EnvType {
 	ENV_TYPE_NS,		// Network server
 };
 
+// Maximum number of pages one IPC message can carry
+#define IPC_MAXPAGES		16
+
+// One page of a multi-page IPC message
+struct IpcPage {
+	void *ip_va;			// Page-aligned address in the sender
+	int ip_perm;			// Permissions to map it with
+};
+
+// Argument block of the multi-page IPC system calls (sys_ipc_sendv
+// and friends): the pages to send, and where to receive pages.
+// Page i of a message is mapped at iv_dstva + i * PGSIZE.
+struct IpcVec {
+	int iv_npages;			// Number of pages to send
+	struct IpcPage iv_pages[IPC_MAXPAGES];
+	void *iv_dstva;			// Start of the receive window
+	int iv_dstnpages;		// Size of the receive window in pages
+};
+
 struct Env {
 	struct Trapframe env_tf;	// Saved registers
 	struct Env *env_link;		// Next free Env
@@ -67,6 +101,39 @@ struct Env {
 	uint32_t env_ipc_value;		// Data value sent to us
 	envid_t env_ipc_from;		// envid of the sender
 	int env_ipc_perm;		// Perm of page mapping received
+	int env_ipc_dstnpages;		// Pages we can receive at env_ipc_dstva
+	int env_ipc_npages;		// Number of pages received
+
+	// Blocking IPC send
+	struct Env *env_ipc_senders;	// Queue of envs blocked sending to us
+	struct Env *env_ipc_senders_tail;
+	struct Env *env_ipc_send_next;	// Next env on the same sender queue
+	struct Env *env_ipc_send_to;	// Env we are blocked sending to
+	uint32_t env_ipc_send_value;	// Our pending message while blocked
+	struct IpcPage env_ipc_send_pages[IPC_MAXPAGES];
+	int env_ipc_send_npages;
+
+	// Call/reply IPC
+	envid_t env_ipc_waitfor;	// Only accept messages from this env, or 0
+	bool env_ipc_calling;		// Blocked sending in sys_ipc_call
+	struct Env *env_ipc_callers;	// Envs waiting for our reply
+	struct Env *env_ipc_caller_next; // Next env waiting on the same env
+	struct Env **env_ipc_caller_pprev; // Link pointing to us, or NULL
+
+	// Scheduler run queue
+	struct Env *env_rq_next;	// Next env on the run queue
+	struct Env *env_rq_prev;	// Previous env on the run queue
+	int env_rq_cpu;			// CPU whose run queue holds us, or -1
+	int env_rq_level;		// Priority level we are queued at
+	int env_priority;		// Base scheduling priority
+	bool env_prio_boost;		// Woken by IPC; run ahead of our peers
+	int env_prio_adj;		// Feedback: -1 per full slice, +1 per wait
+	uint64_t env_rq_since;		// When we were queued (time_nsec)
+
+	// Kernel timer (see kern/timer.c)
+	struct Env *env_timer_next;	// Next env in the same timer wheel slot
+	struct Env **env_timer_pprev;	// Link pointing to us, or NULL if unarmed
+	uint32_t env_timer_expire;	// Tick at which our timer fires
 };
 
 #endif // !JOS_INC_ENV_H
@@ -63,7 +63,8 @@ struct Super {
 enum {
 	FSREQ_OPEN = 1,
 	FSREQ_SET_SIZE,
-	// Read returns a Fsret_read on the request page
+	// Read replies with the pages holding the data and returns a
+	// Fsret_read on the request page
 	FSREQ_READ,
 	FSREQ_WRITE,
 	// Stat returns a Fsret_stat on the request page
@@ -87,7 +88,7 @@ union Fsipc {
 		size_t req_n;
 	} read;
 	struct Fsret_read {
-		char ret_buf[PGSIZE];
+		off_t ret_off;	// Offset of the data in the first page
 	} readRet;
 	struct Fsreq_write {
 		int req_fileid;
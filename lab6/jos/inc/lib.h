@@ -22,6 +22,8 @@
 #include <inc/args.h>
 #include <inc/malloc.h>
 #include <inc/ns.h>
+#include <inc/chan.h>
+#include <inc/time.h>
 
 #define USED(x)		(void)(x)
 
@@ -33,6 +35,7 @@ extern const char *binaryname;
 extern const volatile struct Env *thisenv;
 extern const volatile struct Env envs[NENV];
 extern const volatile struct PageInfo pages[];
+extern const struct TimeInfo timeinfo;
 
 // exit.c
 void	exit(void);
@@ -53,15 +56,35 @@ static envid_t sys_exofork(void);
 int	sys_env_set_status(envid_t env, int status);
 int	sys_env_set_trapframe(envid_t env, struct Trapframe *tf);
 int	sys_env_set_pgfault_upcall(envid_t env, void *upcall);
+int	sys_env_set_priority(envid_t env, int prio);
+int	sys_sched_set_policy(int policy);
 int	sys_page_alloc(envid_t env, void *pg, int perm);
 int	sys_page_map(envid_t src_env, void *src_pg,
 		     envid_t dst_env, void *dst_pg, int perm);
 int	sys_page_unmap(envid_t env, void *pg);
 int	sys_ipc_try_send(envid_t to_env, uint32_t value, void *pg, int perm);
+int	sys_ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int	sys_ipc_recv(void *rcv_pg);
+int	sys_ipc_call(envid_t to_env, uint32_t value, void *pg, int perm, void *rcv_pg);
+int	sys_ipc_reply_wait(envid_t to_env, uint32_t value, void *pg, int perm, void *rcv_pg);
+int	sys_ipc_sendv(envid_t to_env, uint32_t value, const struct IpcVec *vec);
+int	sys_ipc_recvv(const struct IpcVec *vec);
+int	sys_ipc_callv(envid_t to_env, uint32_t value, const struct IpcVec *vec);
+int	sys_ipc_reply_waitv(envid_t to_env, uint32_t value, const struct IpcVec *vec);
+int	sys_chan_create(void *va, int perm);
+int	sys_chan_wait(void *va, int what);
+int	sys_chan_notify(void *va);
+int	sys_batch(struct BatchCall *calls, int n);
+int	sys_sleep(uint32_t msec);
+int	sys_ipc_recv_timeout(void *rcv_pg, uint32_t msec);
 unsigned int sys_time_msec(void);
 int sys_transmit_packet(char *data, int len);
 int sys_receive_packet(char *data_store, int *len_store);
+int sys_transmit_sg(const struct TxSeg *segs, int nsegs);
+int sys_receive_page(void *va);
+int sys_transmit_packets(const struct TxSeg *pkts, int npkts);
+int sys_receive_pages(void *va, int npages);
+int sys_receive_wait(void);
 
 // This must be inlined.  Exercise for reader: why?
 static inline envid_t __attribute__((always_inline))
@@ -74,11 +97,41 @@ sys_exofork(void)
 	return ret;
 }
 
+// time.c
+unsigned int time_msec(void);
+uint64_t time_nsec(void);
+
 // ipc.c
 void	ipc_send(envid_t to_env, uint32_t value, void *pg, int perm);
 int32_t ipc_recv(envid_t *from_env_store, void *pg, int *perm_store);
+int32_t ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+			 uint32_t msec);
+int32_t ipc_call(envid_t to_env, uint32_t value, void *pg, int perm,
+		 void *rcv_pg, int *perm_store);
+int32_t ipc_reply_wait(envid_t to_env, uint32_t value, void *pg, int perm,
+		       envid_t *from_env_store, void *rcv_pg, int *perm_store);
+int32_t ipc_callv(envid_t to_env, uint32_t value, const struct IpcVec *vec,
+		  int *perm_store);
+int32_t ipc_reply_waitv(envid_t to_env, uint32_t value, const struct IpcVec *vec,
+			envid_t *from_env_store, int *perm_store);
 envid_t	ipc_find_env(enum EnvType type);
 
+// chan.c
+int	chan_create(struct ChanRing *ring, size_t slotsize);
+int	chan_send(struct ChanRing *ring, const void *msg);
+int	chan_recv(struct ChanRing *ring, void *msg);
+
+// batch.c
+#define BATCH_NCALLS	32
+struct Batch {
+	int b_ncalls;
+	struct BatchCall b_calls[BATCH_NCALLS];
+};
+void	batch_init(struct Batch *b);
+int	batch_add(struct Batch *b, uint32_t num, uint32_t a1, uint32_t a2,
+		  uint32_t a3, uint32_t a4, uint32_t a5);
+int	batch_flush(struct Batch *b);
+
 // fork.c
 #define	PTE_SHARE	0x400
 envid_t	fork(void);
@@ -49,9 +49,11 @@
  *                     |  Cur. Page Table (User R-)   | R-/R-  PTSIZE
  *    UVPT      ---->  +------------------------------+ 0xef400000
  *                     |          RO PAGES            | R-/R-  PTSIZE
- *    UPAGES    ---->  +------------------------------+ 0xef000000
- *                     |           RO ENVS            | R-/R-  PTSIZE
- * UTOP,UENVS ------>  +------------------------------+ 0xeec00000
+ *    UPAGES    ---->  +------------------------------+ 0xef000000      --+
+ *                     |           RO TIME            | R-/R-  PGSIZE     |
+ *    UTIME     ---->  | - - - - - - - - - - - - - - -| 0xeefff000      PTSIZE
+ *                     |           RO ENVS            | R-/R-             |
+ * UTOP,UENVS ------>  +------------------------------+ 0xeec00000      --+
  * UXSTACKTOP -/       |     User Exception Stack     | RW/RW  PGSIZE
  *                     +------------------------------+ 0xeebff000
  *                     |       Empty Memory (*)       | --/--  PGSIZE
@@ -114,6 +116,9 @@
 #define UPAGES		(UVPT - PTSIZE)
 // Read-only copies of the global env structures
 #define UENVS		(UPAGES - PTSIZE)
+// Read-only kernel time page (see inc/time.h), in the last page of the
+// UENVS region
+#define UTIME		(UPAGES - PGSIZE)
 
 /*
  * Top of user VM. User can manipulate VA from UTOP-1 and down!
@@ -185,6 +190,13 @@ struct PageInfo {
 	// boot_alloc do not have valid reference count fields.
 
 	uint16_t pp_ref;
+
+	// For the first page of a free block in the buddy allocator:
+	// whether it is one, and its size as a power of two pages.
+	uint8_t pp_free;
+	uint8_t pp_order;
+	// Where the pointer to this page on its free list is.
+	struct PageInfo **pp_pprev;
 };
 
 #endif /* !__ASSEMBLER__ */
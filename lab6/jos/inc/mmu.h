@@ -89,6 +89,7 @@
 #define CR0_PG		0x80000000	// Paging
 
 #define CR4_PCE		0x00000100	// Performance counter enable
+#define CR4_PGE		0x00000080	// Page Global Enable
 #define CR4_MCE		0x00000040	// Machine Check Enable
 #define CR4_PSE		0x00000010	// Page Size Extensions
 #define CR4_DE		0x00000008	// Debugging Extensions
@@ -96,6 +97,16 @@
 #define CR4_PVI		0x00000002	// Protected-Mode Virtual Interrupts
 #define CR4_VME		0x00000001	// V86 Mode Extensions
 
+// CPUID leaf 1 feature flags (in %edx)
+#define CPUID_PSE	0x00000008	// 4MB pages
+#define CPUID_SEP	0x00000800	// sysenter/sysexit
+#define CPUID_PGE	0x00002000	// Global pages
+
+// Model-specific registers
+#define MSR_SYSENTER_CS		0x174	// Code segment sysenter loads
+#define MSR_SYSENTER_ESP	0x175	// Stack pointer sysenter loads
+#define MSR_SYSENTER_EIP	0x176	// Entry point sysenter jumps to
+
 // Eflags register
 #define FL_CF		0x00000001	// Carry Flag
 #define FL_PF		0x00000004	// Parity Flag
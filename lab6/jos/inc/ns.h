@@ -5,10 +5,15 @@
 
 #include <inc/types.h>
 #include <inc/mmu.h>
+#include <inc/syscall.h>
 #include <lwip/sockets.h>
 
+// A frame passed between the network server, its helpers and the
+// e1000 driver, which lays received frames out the same way (see
+// E1000_RXPKTOFF in kern/e1000.h).
 struct jif_pkt {
 	int jp_len;
+	struct PktCsum jp_csum;		// Checksum offloads
 	char jp_data[0];
 };
 
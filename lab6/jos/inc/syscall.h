@@ -1,6 +1,8 @@
 #ifndef JOS_INC_SYSCALL_H
 #define JOS_INC_SYSCALL_H
 
+#include <inc/types.h>
+
 /* system call numbers */
 enum {
 	SYS_cputs = 0,
@@ -20,7 +22,74 @@ enum {
 	SYS_time_msec,
 	SYS_transmit_packet,
   SYS_receive_packet,
+	SYS_env_set_priority,
+	SYS_ipc_send,
+	SYS_ipc_call,
+	SYS_ipc_reply_wait,
+	SYS_chan_create,
+	SYS_chan_wait,
+	SYS_chan_notify,
+	SYS_ipc_sendv,
+	SYS_ipc_recvv,
+	SYS_ipc_callv,
+	SYS_ipc_reply_waitv,
+	SYS_batch,
+	SYS_sleep,
+	SYS_ipc_recv_timeout,
+	SYS_receive_wait,
+	SYS_receive_page,
+	SYS_transmit_sg,
+	SYS_transmit_packets,
+	SYS_receive_pages,
+	SYS_sched_set_policy,
   NSYSCALLS
 };
 
+// Maximum number of calls in one sys_batch vector
+#define BATCH_MAXCALLS	256
+
+// One system call in a sys_batch vector
+struct BatchCall {
+	uint32_t bc_num;		// System call number
+	uint32_t bc_args[5];		// Its arguments
+	int32_t bc_ret;			// Its return value, filled in by sys_batch
+};
+
+// Maximum number of segments in one sys_transmit_sg frame
+#define TX_MAXSEGS	8
+
+// Maximum number of frames one sys_transmit_packets or
+// sys_receive_pages moves
+#define NET_MAXBATCH	16
+
+// Checksum offload for a frame, in struct TxSeg and struct jif_pkt.
+// On transmit, the card fills in the IPv4 header checksum and the TCP
+// or UDP checksum, which the sender seeds with the sum of the
+// pseudo-header; offsets are from the start of the frame.  On receive,
+// pc_flags says which checksums the card found good.
+// With PKTCSUM_TSO, the card also splits a TCP frame into segments of
+// pc_mss bytes, each after a copy of the first pc_hdrlen bytes; the
+// pseudo-header sum then leaves out the TCP length.
+struct PktCsum {
+	uint8_t pc_flags;		// PKTCSUM_* below
+	uint8_t pc_ipcss;		// Start of the IP header
+	uint8_t pc_tucss;		// Start of the TCP or UDP header
+	uint8_t pc_tucso;		// Offset of its checksum field
+	uint8_t pc_hdrlen;		// TSO: length of all the headers
+	uint8_t pc_reserved;
+	uint16_t pc_mss;		// TSO: TCP payload per segment
+};
+
+#define PKTCSUM_IP	0x01		// The IPv4 header checksum
+#define PKTCSUM_L4	0x02		// The TCP or UDP checksum
+#define PKTCSUM_TSO	0x04		// TCP segmentation, with both
+
+// One piece of a frame for sys_transmit_sg, or one whole frame for
+// sys_transmit_packets
+struct TxSeg {
+	const void *ts_va;		// Start of the data
+	int ts_len;			// Its length in bytes
+	struct PktCsum ts_csum;		// Offloads; only a frame's first counts
+};
+
 #endif /* !JOS_INC_SYSCALL_H */
@@ -0,0 +1,20 @@
+// The time page: the kernel's clock calibration, exported read-only to
+// every environment at UTIME, so that user code can read the time
+// without a system call (see lib/time.c).  The kernel fills it in once
+// at boot.
+//
+// Time since boot is (read_tsc() - ti_tsc_boot) / ti_tsc_per_msec
+// milliseconds.  JOS assumes the TSCs of all CPUs run in step at a
+// constant rate.
+
+#ifndef JOS_INC_TIME_H
+#define JOS_INC_TIME_H
+
+#include <inc/types.h>
+
+struct TimeInfo {
+	uint64_t ti_tsc_boot;		// TSC when the clock started
+	uint32_t ti_tsc_per_msec;	// TSC cycles per millisecond
+};
+
+#endif	// !JOS_INC_TIME_H
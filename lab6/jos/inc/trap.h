@@ -38,6 +38,7 @@
 #define IRQ_SPURIOUS     7
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKEUP      20	// IPI to wake a halted CPU with new work
 
 #ifndef __ASSEMBLER__
 
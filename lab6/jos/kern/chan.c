@@ -0,0 +1,187 @@
+// Kernel side of shared-memory channels (see inc/chan.h): a table of
+// ring pages, each with the consumer and the producer blocked waiting
+// on it, if any.
+// An environment names a channel by the address it has the ring page
+// mapped at, so anyone holding a mapping of the ring may use it.
+//
+// The table is protected by the big kernel lock.
+
+#include <inc/error.h>
+#include <inc/assert.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/sched.h>
+#include <kern/ipc.h>
+#include <kern/chan.h>
+
+struct Channel {
+	struct PageInfo *ch_page;	// The ring page, or NULL if unused
+	struct Env *ch_waiter;		// Consumer blocked in chan_wait
+	struct Env *ch_sender;		// Producer blocked in chan_wait
+};
+
+static struct Channel chans[NCHAN];
+
+// Allocate a new channel and map its zeroed ring page at 'va' in
+// environment e with permission 'perm'.  The table keeps a reference
+// to the ring page of its own; a channel is reclaimed once that is the
+// only reference left and nobody is waiting on it.
+//
+// Returns the channel number on success, < 0 on error.  Errors are:
+//	-E_NO_MEM if the table is full or there's no memory for the ring
+//		page or a page table.
+int
+chan_create(struct Env *e, void *va, int perm)
+{
+	struct Channel *ch = NULL;
+	struct PageInfo *pp;
+	int i, r;
+
+	for (i = 0; i < NCHAN; i++) {
+		if (chans[i].ch_page && chans[i].ch_page->pp_ref == 1 &&
+		    !chans[i].ch_waiter && !chans[i].ch_sender) {
+			page_decref(chans[i].ch_page);
+			chans[i].ch_page = NULL;
+		}
+		if (!chans[i].ch_page && !ch)
+			ch = &chans[i];
+	}
+	if (!ch)
+		return -E_NO_MEM;
+
+	if (!(pp = page_alloc(ALLOC_ZERO)))
+		return -E_NO_MEM;
+	__sync_add_and_fetch(&pp->pp_ref, 1);
+
+	env_lock(e);
+	r = page_insert(e->env_pgdir, pp, va, perm);
+	env_unlock(e);
+	if (r < 0) {
+		page_decref(pp);
+		return r;
+	}
+
+	ch->ch_page = pp;
+	ch->ch_waiter = NULL;
+	ch->ch_sender = NULL;
+	return ch - chans;
+}
+
+// Find the channel whose ring is mapped at 'va' in the current
+// environment, or NULL.
+static struct Channel *
+chan_lookup(void *va)
+{
+	struct PageInfo *pp;
+	int i;
+
+	env_lock(curenv);
+	pp = page_lookup(curenv->env_pgdir, va, NULL);
+	env_unlock(curenv);
+	if (!pp)
+		return NULL;
+	for (i = 0; i < NCHAN; i++)
+		if (chans[i].ch_page == pp)
+			return &chans[i];
+	return NULL;
+}
+
+static bool
+chan_empty(struct Channel *ch)
+{
+	struct ChanRing *ring = page2kva(ch->ch_page);
+
+	return ring->cr_head == ring->cr_tail;
+}
+
+static bool
+chan_full(struct Channel *ch)
+{
+	struct ChanRing *ring = page2kva(ch->ch_page);
+
+	return ring->cr_tail - ring->cr_head >= ring->cr_nslots;
+}
+
+// Wake the environment waiting in *waiter, if any.
+static void
+chan_wake(struct Env **waiter)
+{
+	struct Env *e;
+
+	if ((e = *waiter) != NULL) {
+		*waiter = NULL;
+		if (e->env_status == ENV_NOT_RUNNABLE)
+			ipc_wake(e, 0);
+	}
+}
+
+// Block the current environment until the ring of the channel mapped
+// at 'va' is non-empty (what == CHAN_WAIT_DATA) or not full
+// (what == CHAN_WAIT_ROOM).  Returns 0 right away if it already is;
+// otherwise gives up the CPU, and the system call returns 0 once the
+// other side calls chan_notify.
+//
+// Returns < 0 on error.  Errors are:
+//	-E_INVAL if no channel is mapped at va, or what is invalid.
+//	-E_INVAL if another environment is already waiting on the same
+//		side of the channel.
+int
+chan_wait(void *va, int what)
+{
+	struct Channel *ch;
+	struct Env **waiter;
+
+	if (!(ch = chan_lookup(va)))
+		return -E_INVAL;
+	if (what == CHAN_WAIT_DATA) {
+		if (!chan_empty(ch))
+			return 0;
+		waiter = &ch->ch_waiter;
+	} else if (what == CHAN_WAIT_ROOM) {
+		if (!chan_full(ch))
+			return 0;
+		waiter = &ch->ch_sender;
+	} else
+		return -E_INVAL;
+	if (*waiter && *waiter != curenv)
+		return -E_INVAL;
+
+	*waiter = curenv;
+	curenv->env_status = ENV_NOT_RUNNABLE;
+	sched_yield();
+}
+
+// Wake the consumer waiting on the channel mapped at 'va' if the ring
+// is non-empty, and the producer if it is not full.  Each side calls
+// this after its own progress, so only the other side is ever woken.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if no channel is mapped at va.
+int
+chan_notify(void *va)
+{
+	struct Channel *ch;
+
+	if (!(ch = chan_lookup(va)))
+		return -E_INVAL;
+	if (!chan_empty(ch))
+		chan_wake(&ch->ch_waiter);
+	if (!chan_full(ch))
+		chan_wake(&ch->ch_sender);
+	return 0;
+}
+
+// Forget environment e as a waiter before it is freed.
+void
+chan_cancel(struct Env *e)
+{
+	int i;
+
+	for (i = 0; i < NCHAN; i++) {
+		if (chans[i].ch_waiter == e)
+			chans[i].ch_waiter = NULL;
+		if (chans[i].ch_sender == e)
+			chans[i].ch_sender = NULL;
+	}
+}
@@ -0,0 +1,15 @@
+#ifndef JOS_KERN_CHAN_H
+#define JOS_KERN_CHAN_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+#include <inc/chan.h>
+
+int	chan_create(struct Env *e, void *va, int perm);
+int	chan_wait(void *va, int what);
+int	chan_notify(void *va);
+void	chan_cancel(struct Env *e);
+
+#endif /* !JOS_KERN_CHAN_H */
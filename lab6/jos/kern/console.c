@@ -9,10 +9,34 @@
 #include <kern/console.h>
 #include <kern/trap.h>
 #include <kern/picirq.h>
+#include <kern/spinlock.h>
 
 static void cons_intr(int (*proc)(void));
 static void cons_putc(int c);
 
+// The console lock serializes the output devices and the input buffer
+// across CPUs.  Once the kernel has panicked we stop taking it, so the
+// panic message and the monitor still work if a CPU died holding it.
+static struct spinlock cons_lock = {
+#ifdef DEBUG_SPINLOCK
+	.name = "cons_lock"
+#endif
+};
+
+static void
+cons_lock_acquire(void)
+{
+	if (!panicstr)
+		spin_lock(&cons_lock);
+}
+
+static void
+cons_lock_release(void)
+{
+	if (!panicstr)
+		spin_unlock(&cons_lock);
+}
+
 // Stupid I/O delay routine necessitated by historical PC design flaws
 static void
 delay(void)
@@ -313,6 +337,9 @@ static uint8_t *charcode[4] = {
 	ctlmap
 };
 
+// Set by kbd_proc_data on Ctrl-Alt-Del
+static bool kbd_reboot;
+
 /*
  * Get data from the keyboard.  If we finish a character, return it.  Else 0.
  * Return -1 if no data.
@@ -360,11 +387,10 @@ kbd_proc_data(void)
 	}
 
 	// Process special keys
-	// Ctrl-Alt-Del: reboot
-	if (!(~shift & (CTL | ALT)) && c == KEY_DEL) {
-		cprintf("Rebooting!\n");
-		outb(0x92, 0x3); // courtesy of Chris Frost
-	}
+	// Ctrl-Alt-Del: reboot, once kbd_intr has dropped cons_lock,
+	// which cprintf needs
+	if (!(~shift & (CTL | ALT)) && c == KEY_DEL)
+		kbd_reboot = 1;
 
 	return c;
 }
@@ -373,6 +399,10 @@ void
 kbd_intr(void)
 {
 	cons_intr(kbd_proc_data);
+	if (kbd_reboot) {
+		cprintf("Rebooting!\n");
+		outb(0x92, 0x3); // courtesy of Chris Frost
+	}
 }
 
 static void
@@ -405,6 +435,7 @@ cons_intr(int (*proc)(void))
 {
 	int c;
 
+	cons_lock_acquire();
 	while ((c = (*proc)()) != -1) {
 		if (c == 0)
 			continue;
@@ -412,6 +443,7 @@ cons_intr(int (*proc)(void))
 		if (cons.wpos == CONSBUFSIZE)
 			cons.wpos = 0;
 	}
+	cons_lock_release();
 }
 
 // return the next input character from the console, or 0 if none waiting
@@ -427,22 +459,26 @@ cons_getc(void)
 	kbd_intr();
 
 	// grab the next character from the input buffer.
+	c = 0;
+	cons_lock_acquire();
 	if (cons.rpos != cons.wpos) {
 		c = cons.buf[cons.rpos++];
 		if (cons.rpos == CONSBUFSIZE)
 			cons.rpos = 0;
-		return c;
 	}
-	return 0;
+	cons_lock_release();
+	return c;
 }
 
 // output a character to the console
 static void
 cons_putc(int c)
 {
+	cons_lock_acquire();
 	serial_putc(c);
 	lpt_putc(c);
 	cga_putc(c);
+	cons_lock_release();
 }
 
 // initialize the console devices
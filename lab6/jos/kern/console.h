@@ -23,4 +23,7 @@ int cons_getc(void);
 void kbd_intr(void); // irq 1
 void serial_intr(void); // irq 4
 
+// Set by the first call to panic (see kern/init.c).
+extern const char *panicstr;
+
 #endif /* _CONSOLE_H_ */
@@ -23,6 +23,8 @@ struct CpuInfo {
 	volatile unsigned cpu_status;   // The status of the CPU
 	struct Env *cpu_env;            // The currently-running environment.
 	struct Taskstate cpu_ts;        // Used by x86 to find stack for interrupt
+	uint64_t cpu_quantum_end;       // When cpu_env's time slice runs out (ns)
+	uint64_t cpu_timer_at;          // When our LAPIC timer fires (ns), or 0
 };
 
 // Initialized in mpconfig.c
@@ -42,5 +44,8 @@ void lapic_init(void);
 void lapic_startap(uint8_t apicid, uint32_t addr);
 void lapic_eoi(void);
 void lapic_ipi(int vector);
+void lapic_ipi_cpu(int apicid, int vector);
+void lapic_timer_calibrate(void);
+void lapic_timer_oneshot(uint64_t nsec);
 
 #endif
@@ -1,18 +1,40 @@
 #include <kern/e1000.h>
 #include <kern/pmap.h>
+#include <kern/env.h>
+#include <kern/sched.h>
+#include <kern/picirq.h>
 #include <inc/string.h>
+#include <inc/error.h>
 // e1000 mmio region
 volatile void *e1000_mmio;
 
-// transmit descriptor queue
-struct e1000_tdesc e1000_tdesc_queue[E1000_MAXTXQUEUE];
-// transmit packets buffer
-char e1000_tx_pkt_buffer[E1000_MAXTXQUEUE][E1000_TXPKTSIZE];
-
-// receive descriptor queue 
-struct e1000_rdesc e1000_rdesc_queue[E1000_MAXRXQUEUE];
-// receive packets buffer
-char e1000_rx_pkt_buffer[E1000_MAXRXQUEUE][E1000_RXPKTSIZE];
+// ring configuration
+unsigned e1000_ntxdesc = E1000_NTXDESC;
+unsigned e1000_nrxdesc = E1000_NRXDESC;
+unsigned e1000_rxbufsize = E1000_RXBUFSIZE;
+// longest frame we transmit: as long as we can receive
+static int e1000_tx_maxlen;
+
+// transmit descriptor queue, a page from page_alloc
+struct e1000_tdesc *e1000_tdesc_queue;
+// transmit packets buffer, two to a page
+char *e1000_tx_pkt_buffer[E1000_MAXDESC];
+// pages pinned by descriptors that transmit straight out of user
+// memory, until the card has sent them
+struct PageInfo *e1000_tx_pinned[E1000_MAXDESC];
+// checksum offload the card was last given a context descriptor for
+static struct PktCsum e1000_tx_ctx;
+
+// receive descriptor queue, a page from page_alloc
+struct e1000_rdesc *e1000_rdesc_queue;
+// receive packet pages: the card DMAs each frame E1000_RXPKTOFF bytes
+// into its page, just past the jp_len of the struct jif_pkt that the
+// page holds, so the page can be handed to user space as it is.  With
+// 4096-byte buffers, a second page follows it, which the card may
+// spill the end of the buffer into.
+struct PageInfo *e1000_rx_pages[E1000_MAXDESC];
+// the frame being received spans descriptors and is being dropped
+static bool e1000_rx_dropping;
 
 // transmit descriptor queue head & tail
 struct e1000_tdh *tdh;
@@ -22,6 +44,12 @@ struct e1000_tdt *tdt;
 struct e1000_rdh *rdh;
 struct e1000_rdt *rdt;
 
+// IRQ line the e1000 interrupts on, or 0 if we can't take its interrupts
+uint8_t e1000_irq;
+
+// env blocked in e1000_receive_wait, or 0
+static envid_t e1000_rx_waiter;
+
 // e1000 register address
 #define E1000REG(offset)  (void *)(e1000_mmio+offset)
 
@@ -34,6 +62,16 @@ int pci_e1000_attach(struct pci_func *pcif){
 
   // pci e1000 init
   pci_func_enable(pcif);
+
+  if(e1000_ntxdesc < E1000_DESCALIGN || e1000_ntxdesc > E1000_MAXDESC ||
+     e1000_ntxdesc % E1000_DESCALIGN ||
+     e1000_nrxdesc < E1000_DESCALIGN || e1000_nrxdesc > E1000_MAXDESC ||
+     e1000_nrxdesc % E1000_DESCALIGN ||
+     (e1000_rxbufsize != 2048 && e1000_rxbufsize != 4096)){
+    panic("e1000: bad ring configuration %u/%u descriptors, %u-byte buffers",
+          e1000_ntxdesc, e1000_nrxdesc, e1000_rxbufsize);
+  }
+  e1000_tx_maxlen = e1000_rxbufsize == 4096 ? E1000_JUMBOPKTSIZE : E1000_TXPKTSIZE;
   cprintf("PCI BAR information: 0x%x, 0x%x\n", pcif->reg_base[0], pcif->reg_size[0]);
   
   //e1000 set mmio
@@ -46,6 +84,14 @@ int pci_e1000_attach(struct pci_func *pcif){
   // e1000 receive init
   e1000_receive_init();
 
+  // take receive interrupts, if trap_init has a gate for its line
+  if(pcif->irq_line >= 9 && pcif->irq_line <= 11){
+    e1000_irq = pcif->irq_line;
+    irq_setmask_8259A(irq_mask_8259A & ~(1 << e1000_irq));
+  }else{
+    cprintf("e1000: no handler for irq %d, polling only\n", pcif->irq_line);
+  }
+
   // e1000 transmit test
   // e1000_transmit_packet(test_string, 9);
   
@@ -61,8 +107,22 @@ void e1000_transmit_init(){
   struct e1000_tdlen *tdlen;
   struct e1000_tctl *tctl;
   struct e1000_tipg *tipg;
+  struct PageInfo *pp;
 
-  for(i = 0; i < E1000_MAXTXQUEUE; i++){
+  if((pp = page_alloc(ALLOC_ZERO)) == NULL){
+    panic("e1000_transmit_init: out of memory");
+  }
+  __sync_add_and_fetch(&pp->pp_ref, 1);
+  e1000_tdesc_queue = page2kva(pp);
+
+  for(i = 0; i < e1000_ntxdesc; i++){
+    if(i % 2 == 0){
+      if((pp = page_alloc(0)) == NULL){
+        panic("e1000_transmit_init: out of memory");
+      }
+      __sync_add_and_fetch(&pp->pp_ref, 1);
+    }
+    e1000_tx_pkt_buffer[i] = page2kva(pp) + (i % 2) * (PGSIZE / 2);
     e1000_tdesc_queue[i].addr = PADDR(e1000_tx_pkt_buffer[i]);
     e1000_tdesc_queue[i].cmd  |= E1000_TXD_CMD_RS;
     e1000_tdesc_queue[i].status |= E1000_TXD_STAT_DD;
@@ -75,7 +135,8 @@ void e1000_transmit_init(){
   tdbah->tdbah = 0;
 
   tdlen = (struct e1000_tdlen *)E1000REG(E1000_TDLEN);
-  tdlen->len = E1000_MAXTXQUEUE;
+  // in units of 128 bytes
+  tdlen->len = e1000_ntxdesc * sizeof(struct e1000_tdesc) / 128;
 
   tdh = (struct e1000_tdh *)E1000REG(E1000_TDH);
   tdh->tdh = 0;
@@ -95,28 +156,264 @@ void e1000_transmit_init(){
   tipg->ipgr2 = 6;
 }
 
+// release the page pinned by transmit descriptor i, whose DD bit
+// says the card is done with it
+static void e1000_tx_unpin(int i){
+  if(e1000_tx_pinned[i]){
+    page_decref(e1000_tx_pinned[i]);
+    e1000_tx_pinned[i] = NULL;
+  }
+}
+
 // transmit packet
 int e1000_transmit_packet(char *data, int len){
   uint16_t tail = tdt->tdt;
   
+  if(len <= 0 || len > E1000_TXPKTSIZE){
+    return -E_INVAL;
+  }
   // the transmit queue is full
   if(!(e1000_tdesc_queue[tail].status & E1000_TXD_STAT_DD)){
     return -1;
   }
   
+  e1000_tx_unpin(tail);
+  e1000_tdesc_queue[tail].addr = PADDR(e1000_tx_pkt_buffer[tail]);
   e1000_tdesc_queue[tail].length = len;
-  e1000_tdesc_queue[tail].status &= ~E1000_TXD_STAT_DD;
-  e1000_tdesc_queue[tail].cmd |= (E1000_TXD_CMD_EOP | E1000_TXD_CMD_RS);
+  e1000_tdesc_queue[tail].status = 0;
+  e1000_tdesc_queue[tail].cso = 0;
+  e1000_tdesc_queue[tail].css = 0;
+  e1000_tdesc_queue[tail].cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_RS;
   memcpy(e1000_tx_pkt_buffer[tail], data, len);
-  tdt->tdt = (tail + 1) % E1000_MAXTXQUEUE;
+  tdt->tdt = (tail + 1) % e1000_ntxdesc;
   
   return 0;
 
 }
 
+// Set up the descriptors from *tail on for the frame made of the
+// 'nsegs' pieces in 'segs', which lie in environment e's address
+// space, and advance *tail past them; the caller writes TDT.  Each
+// piece of a segment within one page gets a descriptor of its own,
+// pointing at that page, and the page is pinned with a reference
+// until the card has sent it.  Checksum offload asked for in the
+// first segment goes in extended data descriptors, after a context
+// descriptor if the card hasn't got the right context already; so does
+// TCP segmentation.
+// Returns 0 on success, -1 if the transmit queue is full, or
+// -E_INVAL if the frame is empty, too long or in too many pieces, or
+// its checksum or segmentation parameters are out of place,
+// -E_FAULT if a page of it is not mapped user-readable in e.
+static int e1000_tx_fill(struct Env *e, const struct TxSeg *segs, int nsegs,
+                         uint16_t *tail){
+  struct PageInfo *pps[E1000_TXMAXDESC];
+  physaddr_t pas[E1000_TXMAXDESC];
+  uint16_t lens[E1000_TXMAXDESC];
+  uint16_t d;
+  const struct PktCsum *csum = &segs[0].ts_csum;
+  struct e1000_tctx *ctx;
+  struct e1000_tdata *data;
+  const void *va;
+  pte_t *pte;
+  int i, n = 0, len, piece, total = 0, newctx;
+
+  for(i = 0; i < nsegs; i++){
+    va = segs[i].ts_va;
+    len = segs[i].ts_len;
+    if(len < 0 || va >= (void *)UTOP || len > UTOP - (uintptr_t)va){
+      return -E_INVAL;
+    }
+    while(len > 0){
+      piece = MIN(len, PGSIZE - PGOFF(va));
+      if(n == E1000_TXMAXDESC){
+        return -E_INVAL;
+      }
+      pps[n] = page_lookup(e->env_pgdir, (void *)va, &pte);
+      if(!pps[n] || (*pte & (PTE_U | PTE_P)) != (PTE_U | PTE_P)){
+        return -E_FAULT;
+      }
+      pas[n] = page2pa(pps[n]) + PGOFF(va);
+      lens[n] = piece;
+      n++;
+      total += piece;
+      va += piece;
+      len -= piece;
+    }
+  }
+  if(csum->pc_flags){
+    // the IP header reaches the TCP or UDP header; its checksum fits
+    if(csum->pc_tucss < csum->pc_ipcss + 20 || csum->pc_tucss > total ||
+       ((csum->pc_flags & PKTCSUM_L4) &&
+        (csum->pc_tucso < csum->pc_tucss || csum->pc_tucso + 2 > total))){
+      return -E_INVAL;
+    }
+  }
+  if(csum->pc_flags & PKTCSUM_TSO){
+    // the headers include a TCP header, and each segment is a frame
+    if(!(csum->pc_flags & PKTCSUM_IP) || !(csum->pc_flags & PKTCSUM_L4) ||
+       csum->pc_hdrlen < csum->pc_tucss + 20 || csum->pc_hdrlen >= total ||
+       csum->pc_mss == 0 || csum->pc_hdrlen + csum->pc_mss > e1000_tx_maxlen ||
+       total > E1000_TSOMAXLEN){
+      return -E_INVAL;
+    }
+  }else if(total > e1000_tx_maxlen){
+    return -E_INVAL;
+  }
+  // a TSO context also holds the payload length, so is never reused
+  newctx = csum->pc_flags && ((csum->pc_flags & PKTCSUM_TSO) ||
+                              memcmp(csum, &e1000_tx_ctx, sizeof(*csum)) != 0);
+  // a full ring would look empty to the card
+  if(n == 0 || n + newctx >= e1000_ntxdesc){
+    return -E_INVAL;
+  }
+
+  // all the descriptors must be free
+  for(i = 0; i < n + newctx; i++){
+    if(!(e1000_tdesc_queue[(*tail + i) % e1000_ntxdesc].status & E1000_TXD_STAT_DD)){
+      return -1;
+    }
+  }
+
+  if(newctx){
+    d = *tail;
+    e1000_tx_unpin(d);
+    ctx = (struct e1000_tctx *)&e1000_tdesc_queue[d];
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->ipcss = csum->pc_ipcss;
+    ctx->ipcso = csum->pc_ipcss + 10;   // the IP header's checksum field
+    ctx->ipcse = csum->pc_tucss - 1;
+    ctx->tucss = csum->pc_tucss;
+    ctx->tucso = csum->pc_tucso;
+    ctx->tucse = 0;                     // to the end of the frame
+    ctx->dtyp = E1000_TXD_DTYP_C;
+    ctx->tucmd = E1000_TXD_CMD_DEXT | E1000_TXD_CMD_RS | E1000_TXD_TUCMD_IP;
+    if(csum->pc_flags & PKTCSUM_TSO){
+      ctx->tucmd |= E1000_TXD_TUCMD_TSE | E1000_TXD_TUCMD_TCP;
+      ctx->paylen = total - csum->pc_hdrlen;
+      ctx->hdrlen = csum->pc_hdrlen;
+      ctx->mss = csum->pc_mss;
+    }
+    e1000_tx_ctx = *csum;
+    *tail = (*tail + 1) % e1000_ntxdesc;
+  }
+
+  for(i = 0; i < n; i++){
+    d = (*tail + i) % e1000_ntxdesc;
+    e1000_tx_unpin(d);
+    __sync_add_and_fetch(&pps[i]->pp_ref, 1);
+    e1000_tx_pinned[d] = pps[i];
+    if(csum->pc_flags){
+      data = (struct e1000_tdata *)&e1000_tdesc_queue[d];
+      data->addr = pas[i];
+      data->length = lens[i];
+      data->dtyp = E1000_TXD_DTYP_D;
+      data->dcmd = E1000_TXD_CMD_DEXT | E1000_TXD_CMD_RS |
+                   (i == n - 1 ? E1000_TXD_CMD_EOP : 0) |
+                   ((csum->pc_flags & PKTCSUM_TSO) ? E1000_TXD_DCMD_TSE : 0);
+      data->status = 0;
+      data->popts = ((csum->pc_flags & PKTCSUM_IP) ? E1000_TXD_POPTS_IXSM : 0) |
+                    ((csum->pc_flags & PKTCSUM_L4) ? E1000_TXD_POPTS_TXSM : 0);
+      data->special = 0;
+      continue;
+    }
+    e1000_tdesc_queue[d].addr = pas[i];
+    e1000_tdesc_queue[d].length = lens[i];
+    e1000_tdesc_queue[d].cso = 0;
+    e1000_tdesc_queue[d].css = 0;
+    e1000_tdesc_queue[d].status = 0;
+    e1000_tdesc_queue[d].cmd = E1000_TXD_CMD_RS |
+                               (i == n - 1 ? E1000_TXD_CMD_EOP : 0);
+  }
+  *tail = (*tail + n) % e1000_ntxdesc;
+  return 0;
+}
+
+// Transmit a frame made of the 'nsegs' pieces in 'segs', which lie in
+// environment e's address space, without copying it (see
+// e1000_tx_fill).  The caller holds e's env lock.
+// Returns 0 on success, < 0 on error as e1000_tx_fill.
+int e1000_transmit_sg(struct Env *e, const struct TxSeg *segs, int nsegs){
+  uint16_t tail = tdt->tdt;
+  int re;
+
+  if((re = e1000_tx_fill(e, segs, nsegs, &tail)) < 0){
+    return re;
+  }
+  tdt->tdt = tail;
+  return 0;
+}
+
+// Transmit up to 'npkts' frames from environment e's address space
+// without copying them, each described by one element of 'pkts', and
+// tell the card about them with a single write of TDT.  Stops early at
+// the first frame that doesn't fit in the transmit queue or is bad.
+// The caller holds e's env lock.
+// Returns the number of frames queued, which is 0 if the queue is
+// full, or < 0 as e1000_tx_fill if the first frame is bad.
+int e1000_transmit_batch(struct Env *e, const struct TxSeg *pkts, int npkts){
+  uint16_t tail = tdt->tdt;
+  int i, re = -1;
+
+  for(i = 0; i < npkts; i++){
+    if((re = e1000_tx_fill(e, &pkts[i], 1, &tail)) < 0){
+      break;
+    }
+  }
+  if(i == 0){
+    return re == -1 ? 0 : re;
+  }
+  tdt->tdt = tail;
+  return i;
+}
+
+// Allocate a zeroed receive buffer (see e1000_rx_pages), since the
+// card only overwrites the frame itself.
+static struct PageInfo *e1000_rx_alloc(void){
+  if(e1000_rxbufsize == 4096){
+    return page_alloc_order(ALLOC_ZERO, 1);
+  }
+  return page_alloc(ALLOC_ZERO);
+}
+
+// Give receive descriptor i the buffer starting at pp, which the ring
+// holds a reference to, and hand it back to the card (RDT is the
+// caller's).
+static void e1000_rx_fill(int i, struct PageInfo *pp){
+  __sync_add_and_fetch(&pp->pp_ref, 1);
+  if(e1000_rxbufsize == 4096){
+    __sync_add_and_fetch(&pp[1].pp_ref, 1);
+  }
+  e1000_rx_pages[i] = pp;
+  e1000_rdesc_queue[i].addr = page2pa(pp) + E1000_RXPKTOFF;
+  e1000_rdesc_queue[i].status = 0;
+}
+
+// Return the index of the next receive descriptor to take after
+// 'tail', dropping on the way the frames that span descriptors or
+// don't fit in a page with their jp_len, which long packets allow.
+// The descriptors of dropped frames go straight back to the card.
+static uint16_t e1000_rx_next(uint16_t tail){
+  struct e1000_rdesc *d;
+
+  for(;;){
+    tail = (tail + 1) % e1000_nrxdesc;
+    d = &e1000_rdesc_queue[tail];
+    if(!(d->status & E1000_RXD_STAT_DD)){
+      return tail;
+    }
+    if(!e1000_rx_dropping && (d->status & E1000_RXD_STAT_EOP) &&
+       d->length <= E1000_JUMBOPKTSIZE){
+      return tail;
+    }
+    e1000_rx_dropping = !(d->status & E1000_RXD_STAT_EOP);
+    d->status = 0;
+    rdt->rdt = tail;
+  }
+}
+
 // receive packet
 int e1000_receive_packet(char *data_store, int *len_store){
-  uint16_t tail = (rdt->rdt + 1) % E1000_MAXRXQUEUE;
+  uint16_t tail = e1000_rx_next(rdt->rdt);
 
   if(!(e1000_rdesc_queue[tail].status & E1000_RXD_STAT_DD)){  
     return -1;
@@ -125,15 +422,159 @@ int e1000_receive_packet(char *data_store, int *len_store){
   *len_store = e1000_rdesc_queue[tail].length;
   e1000_rdesc_queue[tail].status &= ~E1000_RXD_STAT_DD;
   // e1000_rdesc_queue[tail].cmd |= E1000_RXD_STAT_EOP;
-  memcpy(data_store, e1000_rx_pkt_buffer[tail], *len_store);
-  rdt->rdt = (tail) % E1000_MAXRXQUEUE;
+  memcpy(data_store, page2kva(e1000_rx_pages[tail]) + E1000_RXPKTOFF, *len_store);
+  rdt->rdt = (tail) % e1000_nrxdesc;
   return 0;
 }
 
+// Return the PKTCSUM_* flags for the checksums that the card checked
+// and found good in the frame of receive descriptor d.
+static uint8_t e1000_rx_csum(struct e1000_rdesc *d){
+  uint8_t flags = 0;
+
+  if(d->status & E1000_RXD_STAT_IXSM){
+    return 0;
+  }
+  if((d->status & E1000_RXD_STAT_IPCS) && !(d->errors & E1000_RXD_ERR_IPE)){
+    flags |= PKTCSUM_IP;
+  }
+  if((d->status & E1000_RXD_STAT_TCPCS) && !(d->errors & E1000_RXD_ERR_TCPE)){
+    flags |= PKTCSUM_L4;
+  }
+  return flags;
+}
+
+// Take the packet in receive descriptor 'tail' without copying it:
+// map the page the card received it into at 'va' in environment e with
+// permission 'perm', as a struct jif_pkt, and give the descriptor a
+// fresh page.  The caller writes RDT.
+// Returns the length of the packet, -1 if none is waiting, or
+// -E_NO_MEM if there's no memory for the new page or a page table.
+static int e1000_rx_take(struct Env *e, uint16_t tail, void *va, int perm){
+  struct PageInfo *pp, *fresh;
+  struct PktCsum *csum;
+  int len, re;
+
+  if(!(e1000_rdesc_queue[tail].status & E1000_RXD_STAT_DD)){
+    return -1;
+  }
+
+  if((fresh = e1000_rx_alloc()) == NULL){
+    return -E_NO_MEM;
+  }
+
+  pp = e1000_rx_pages[tail];
+  len = e1000_rdesc_queue[tail].length;
+  // the jp_len and jp_csum of the struct jif_pkt
+  *(int *)page2kva(pp) = len;
+  csum = page2kva(pp) + sizeof(int);
+  memset(csum, 0, sizeof(*csum));
+  csum->pc_flags = e1000_rx_csum(&e1000_rdesc_queue[tail]);
+  if((re = page_insert(e->env_pgdir, pp, va, perm)) < 0){
+    page_free(fresh);
+    if(e1000_rxbufsize == 4096){
+      page_free(fresh + 1);
+    }
+    return re;
+  }
+  // the page now belongs to e, and the spill page is no longer needed
+  page_decref(pp);
+  if(e1000_rxbufsize == 4096){
+    page_decref(pp + 1);
+  }
+
+  e1000_rx_fill(tail, fresh);
+  return len;
+}
+
+// Receive a packet without copying it, mapping its page at 'va' in
+// environment e (see e1000_rx_take).  The caller holds e's env lock
+// and has checked va and perm.
+// Returns the length of the packet, or < 0 as e1000_rx_take.
+int e1000_receive_page(struct Env *e, void *va, int perm){
+  uint16_t tail = e1000_rx_next(rdt->rdt);
+  int len;
+
+  if((len = e1000_rx_take(e, tail, va, perm)) >= 0){
+    rdt->rdt = tail;
+  }
+  return len;
+}
+
+// Receive up to 'npages' packets without copying them, mapping the
+// i'th at va + i*PGSIZE in environment e (see e1000_rx_take), and hand
+// their descriptors back to the card with a single write of RDT.  The
+// caller holds e's env lock and has checked va and perm.
+// Returns the number of packets received, or < 0 as e1000_rx_take if
+// the first one couldn't be.
+int e1000_receive_pages(struct Env *e, void *va, int npages, int perm){
+  uint16_t tail = rdt->rdt, next;
+  int i, re = -1;
+
+  for(i = 0; i < npages; i++){
+    next = e1000_rx_next(tail);
+    if((re = e1000_rx_take(e, next, va + i * PGSIZE, perm)) < 0){
+      break;
+    }
+    tail = next;
+  }
+  if(i == 0){
+    return re;
+  }
+  rdt->rdt = tail;
+  return i;
+}
+
+
+// returns true if a received packet is waiting in the queue
+static bool e1000_receive_ready(){
+  uint16_t tail = e1000_rx_next(rdt->rdt);
+
+  return e1000_rdesc_queue[tail].status & E1000_RXD_STAT_DD;
+}
+
+// Wait for a packet to arrive on behalf of environment envid.
+// Returns 0 if a packet is already waiting, 1 if envid has been
+// recorded as the waiter, which the caller must then block; the
+// receive interrupt makes it runnable again, returning 0.  Only one
+// environment (the input helper) waits at a time.
+// Returns -E_NOT_SUPP if receive interrupts aren't available.
+int e1000_receive_wait(envid_t envid){
+  if(!e1000_irq){
+    return -E_NOT_SUPP;
+  }
+  if(e1000_receive_ready()){
+    return 0;
+  }
+  e1000_rx_waiter = envid;
+  return 1;
+}
+
+// e1000 interrupt handler: wake the environment waiting for packets
+void e1000_intr(){
+  struct Env *e;
+  uint32_t icr;
+
+  // reading ICR acknowledges the interrupt
+  icr = *(volatile uint32_t *)E1000REG(E1000_ICR);
+  if(!(icr & (E1000_ICR_RXT0 | E1000_ICR_RXDMT0 | E1000_ICR_RXO))){
+    return;
+  }
+  if(!e1000_rx_waiter || envid2env(e1000_rx_waiter, &e, 0) < 0){
+    return;
+  }
+  e1000_rx_waiter = 0;
+  if(e->env_status == ENV_NOT_RUNNABLE){
+    e->env_tf.tf_regs.reg_eax = 0;
+    e->env_status = ENV_RUNNABLE;
+    sched_enqueue(e);
+  }
+}
 
 // receive init refer to section 14.4
 void e1000_receive_init(){
   int i;
+  struct PageInfo *pp;
 
   uint64_t *ra;
   uint64_t *mta;
@@ -144,9 +585,18 @@ void e1000_receive_init(){
   struct e1000_rdlen *rdlen;
   struct e1000_rctl *rctl;
   
+  if((pp = page_alloc(ALLOC_ZERO)) == NULL){
+    panic("e1000_receive_init: out of memory");
+  }
+  __sync_add_and_fetch(&pp->pp_ref, 1);
+  e1000_rdesc_queue = page2kva(pp);
+
   // pointers to buffers should be stored in the receive descriptor 
-  for(i = 0; i < E1000_MAXRXQUEUE; i++){
-    e1000_rdesc_queue[i].addr = PADDR(e1000_rx_pkt_buffer[i]); 
+  for(i = 0; i < e1000_nrxdesc; i++){
+    if((pp = e1000_rx_alloc()) == NULL){
+      panic("e1000_receive_init: out of memory");
+    }
+    e1000_rx_fill(i, pp);
   }
   
   // set the mac address
@@ -157,11 +607,16 @@ void e1000_receive_init(){
   *mta =  0x0;
   *(mta + 1) = 0x0;
 
+  // interrupt when a packet arrives, when the free descriptors run
+  // low and on overrun, so that a blocked receiver wakes up
   ims = (struct e1000_ims *)E1000REG(E1000_IMS);
-  ims->ims = 0;
+  ims->ims = E1000_ICR_RXT0 | E1000_ICR_RXDMT0 | E1000_ICR_RXO;
   
   rdtr = (struct e1000_rdtr *)E1000REG(E1000_RDTR);
   rdtr->dtimer = 0;
+
+  // check IP, TCP and UDP checksums, see e1000_rx_csum
+  *(volatile uint32_t *)E1000REG(E1000_RXCSUM) = E1000_RXCSUM_IPOFL | E1000_RXCSUM_TUOFL;
   
   
   // set receive descriptor base address low
@@ -173,24 +628,30 @@ void e1000_receive_init(){
   
   // set receive descriptor queue length
   rdlen = (struct e1000_rdlen *)E1000REG(E1000_RDLEN);
-  rdlen->len = E1000_MAXRXQUEUE;
+  // in units of 128 bytes
+  rdlen->len = e1000_nrxdesc * sizeof(struct e1000_rdesc) / 128;
   
   // set receive descriptor queue head
   rdh = (struct e1000_rdh *)E1000REG(E1000_RDH);
   rdh->rdh = 0;
   // set receive desciptor queue tail 
   rdt = (struct e1000_rdt *)E1000REG(E1000_RDT);
-  rdt->rdt = E1000_MAXRXQUEUE - 1;
+  rdt->rdt = e1000_nrxdesc - 1;
   
   // set receiver control register
   rctl = (struct e1000_rctl *)E1000REG(E1000_RCTL);
   rctl->rcb |= E1000_RCTL_EN;
-  rctl->rcb &= ~E1000_RCTL_LPE;
   rctl->rcb &= ~E1000_RCTL_LBM;
   rctl->rcb &= ~E1000_RCTL_MO_3;
   rctl->rcb |= E1000_RCTL_BAM;
-  // rctl->rcb |= E1000_RCTL_BSEX;
-  // rctl->rcb |= E1000_RCTL_SZ_4096;
+  rctl->rcb &= ~E1000_RCTL_SZ_MASK;
+  if(e1000_rxbufsize == 4096){
+    // 4096-byte buffers, and frames longer than 1522 bytes
+    rctl->rcb |= E1000_RCTL_BSEX | E1000_RCTL_SZ_4096 | E1000_RCTL_LPE;
+  }else{
+    rctl->rcb &= ~(E1000_RCTL_BSEX | E1000_RCTL_LPE);
+    rctl->rcb |= E1000_RCTL_SZ_2048;
+  }
   rctl->rcb |= E1000_RCTL_SECRC;
 }
 
@@ -1,6 +1,8 @@
 #ifndef JOS_KERN_E1001_H
 #define JOS_KERN_E1000_H
 
+#include <inc/env.h>
+#include <inc/syscall.h>
 #include <kern/pci.h>
 
 /* functions */
@@ -8,14 +10,46 @@ int pci_e1000_attach(struct pci_func *pcif);
 void e1000_transmit_init();
 void e1000_receive_init();
 int e1000_transmit_packet(char *data, int len);
+int e1000_transmit_sg(struct Env *e, const struct TxSeg *segs, int nsegs);
+int e1000_transmit_batch(struct Env *e, const struct TxSeg *pkts, int npkts);
 int e1000_receive_packet(char *data_store, int *len_store);
+int e1000_receive_page(struct Env *e, void *va, int perm);
+int e1000_receive_pages(struct Env *e, void *va, int npages, int perm);
+int e1000_receive_wait(envid_t envid);
+void e1000_intr();
+
+extern uint8_t e1000_irq;
+
+/* ring configuration, fixed when the card is attached: build with
+   DEFS=-DE1000_NTXDESC=... to change the defaults */
+#ifndef E1000_NTXDESC
+#define E1000_NTXDESC     256   /* transmit descriptors */
+#endif
+#ifndef E1000_NRXDESC
+#define E1000_NRXDESC     256   /* receive descriptors */
+#endif
+#ifndef E1000_RXBUFSIZE
+#define E1000_RXBUFSIZE   2048  /* 2048, or 4096 for long packets */
+#endif
+/* a ring is one page of descriptors, and a multiple of 128 bytes */
+#define E1000_MAXDESC     256
+#define E1000_DESCALIGN   8
+
+extern unsigned e1000_ntxdesc, e1000_nrxdesc, e1000_rxbufsize;
 
 /* transmit queue */
-#define E1000_MAXTXQUEUE  32
 #define E1000_TXPKTSIZE   1518
+/* transmit descriptors one frame may use */
+#define E1000_TXMAXDESC   16
 /* receive queue */
-#define E1000_MAXRXQUEUE  256
 #define E1000_RXPKTSIZE   1518
+/* offset of the frame in a receive page: the jp_len and jp_csum of a
+   struct jif_pkt */
+#define E1000_RXPKTOFF    12
+/* longest frame to split with TCP segmentation offload */
+#define E1000_TSOMAXLEN   0xffff
+/* longest frame with long packets enabled: what fits in a receive page */
+#define E1000_JUMBOPKTSIZE (PGSIZE - E1000_RXPKTOFF)
 
 /* PCI Vendor ID */
 #define E1000_VENDOR_ID_82540EM 0x8086
@@ -33,7 +67,9 @@ int e1000_receive_packet(char *data_store, int *len_store);
 #define E1000_TCTL     0x00400  /* TX Control - RW */
 #define E1000_TIPG     0x00410  /* TX Inter-packet gap -RW */
 
+#define E1000_ICR      0x000C0  /* Interrupt Cause Read - R/clr */
 #define E1000_IMS      0x000D0  /* Interrupt Mask Set - RW */
+#define E1000_IMC      0x000D8  /* Interrupt Mask Clear - WO */
 #define E1000_RCTL     0x00100  /* RX Control - RW */
 #define E1000_RDBAL    0x02800  /* RX Descriptor Base Address Low - RW */
 #define E1000_RDBAH    0x02804  /* RX Descriptor Base Address High - RW */
@@ -41,6 +77,7 @@ int e1000_receive_packet(char *data_store, int *len_store);
 #define E1000_RDH      0x02810  /* RX Descriptor Head - RW */
 #define E1000_RDT      0x02818  /* RX Descriptor Tail - RW */
 #define E1000_RDTR     0x02820  /* RX Delay Timer - RW */
+#define E1000_RXCSUM   0x05000  /* RX Checksum Control - RW */
 #define E1000_MTA      0x05200  /* Multicast Table Array - RW Array */
 #define E1000_RA       0x05400  /* Receive Address - RW Array */
 
@@ -58,15 +95,36 @@ int e1000_receive_packet(char *data_store, int *len_store);
 #define E1000_TXD_STAT_EC     0x02 /* Excess Collisions */
 #define E1000_TXD_STAT_LC     0x04 /* Late Collisions */
 #define E1000_TXD_STAT_TU     0x08 /* Transmit underrun */
+#define E1000_TXD_DTYP_C      0x0  /* Context Descriptor */
+#define E1000_TXD_DTYP_D      0x1  /* Data Descriptor */
+#define E1000_TXD_TUCMD_TCP   0x01 /* TCP packet (context) */
+#define E1000_TXD_TUCMD_IP    0x02 /* IPv4 packet (context) */
+#define E1000_TXD_TUCMD_TSE   0x04 /* TCP segmentation enable (context) */
+#define E1000_TXD_DCMD_TSE    0x04 /* TCP segmentation enable (data) */
+#define E1000_TXD_POPTS_IXSM  0x01 /* Insert IP checksum */
+#define E1000_TXD_POPTS_TXSM  0x02 /* Insert TCP/UDP checksum */
+
+/* Interrupt Cause Read/Mask Set bits */
+#define E1000_ICR_RXDMT0        0x00000010    /* rx desc min. threshold */
+#define E1000_ICR_RXO           0x00000040    /* rx overrun */
+#define E1000_ICR_RXT0          0x00000080    /* rx timer intr */
 
 #define E1000_RXD_STAT_DD       0x01    /* Descriptor Done */
 #define E1000_RXD_STAT_EOP      0x02    /* End of Packet */
+#define E1000_RXD_STAT_IXSM     0x04    /* Ignore checksum */
+#define E1000_RXD_STAT_TCPCS    0x20    /* TCP/UDP checksum calculated */
+#define E1000_RXD_STAT_IPCS     0x40    /* IP checksum calculated */
+#define E1000_RXD_ERR_TCPE      0x20    /* TCP/UDP checksum error */
+#define E1000_RXD_ERR_IPE       0x40    /* IP checksum error */
+#define E1000_RXCSUM_IPOFL      0x00000100    /* IPv4 checksum offload */
+#define E1000_RXCSUM_TUOFL      0x00000200    /* TCP/UDP checksum offload */
 #define E1000_RCTL_EN           0x00000002    /* enable */
 #define E1000_RCTL_LPE          0x00000020    /* long packet enable */
 #define E1000_RCTL_LBM          0x000000C0    /* no loopback mode */
 #define E1000_RCTL_MO_3         0x00003000    /* multicast offset 15:4 */
 #define E1000_RCTL_BAM          0x00008000    /* broadcast enable */
 #define E1000_RCTL_BSEX         0x02000000    /* Buffer size extension */
+#define E1000_RCTL_SZ_MASK      0x00030000    /* rx buffer size field */
 /* these buffer sizes are valid if E1000_RCTL_BSEX is 0 */
 #define E1000_RCTL_SZ_2048      0x00000000    /* rx buffer size 2048 */
 #define E1000_RCTL_SZ_1024      0x00010000    /* rx buffer size 1024 */
@@ -90,6 +148,34 @@ struct e1000_tdesc{
   uint16_t special;
 }__attribute__((packed));
 
+// transmit context descriptor, which sets up checksum offload for the
+// data descriptors after it (section 3.3.6)
+struct e1000_tctx{
+  uint8_t  ipcss;
+  uint8_t  ipcso;
+  uint16_t ipcse;
+  uint8_t  tucss;
+  uint8_t  tucso;
+  uint16_t tucse;
+  uint32_t paylen : 20;
+  uint32_t dtyp   : 4;
+  uint32_t tucmd  : 8;
+  uint8_t  status;
+  uint8_t  hdrlen;
+  uint16_t mss;
+}__attribute__((packed));
+
+// transmit data descriptor (section 3.3.7)
+struct e1000_tdata{
+  uint64_t addr;
+  uint32_t length : 20;
+  uint32_t dtyp   : 4;
+  uint32_t dcmd   : 8;
+  uint8_t  status;
+  uint8_t  popts;
+  uint16_t special;
+}__attribute__((packed));
+
 // transmit descriptor base address low
 struct e1000_tdbal{
   uint32_t tdbal;
@@ -14,11 +14,29 @@
 #include <kern/sched.h>
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
+#include <kern/ipc.h>
+#include <kern/chan.h>
+#include <kern/time.h>
+#include <kern/timer.h>
 
 struct Env *envs = NULL;		// All environments
 static struct Env *env_free_list;	// Free environment list
 					// (linked by Env->env_link)
 
+// Protects env_free_list and the allocation state of 'envs' slots.
+static struct spinlock env_table_lock = {
+#ifdef DEBUG_SPINLOCK
+	.name = "env_table_lock"
+#endif
+};
+
+// Per-environment locks, indexed like 'envs'.  env_locks[ENVX(id)]
+// protects that environment's IPC state and its page directory, so
+// system calls that run without the big kernel lock can safely map
+// pages into it.  They live here rather than in struct Env because
+// the envs array is also mapped read-only for user space at UENVS.
+static struct spinlock env_locks[NENV];
+
 #define ENVGENSHIFT	12		// >= LOGNENV
 
 // Global descriptor table.
@@ -108,6 +126,44 @@ envid2env(envid_t envid, struct Env **env_store, bool checkperm)
 	return 0;
 }
 
+// Acquire environment e's lock.
+void
+env_lock(struct Env *e)
+{
+	spin_lock(&env_locks[e - envs]);
+}
+
+// Release environment e's lock.
+void
+env_unlock(struct Env *e)
+{
+	spin_unlock(&env_locks[e - envs]);
+}
+
+// Acquire the locks of two environments, which may be the same one.
+// Locks are always taken in envs[] order to avoid deadlock.
+void
+env_lock_pair(struct Env *a, struct Env *b)
+{
+	if (a == b) {
+		env_lock(a);
+	} else if (a < b) {
+		env_lock(a);
+		env_lock(b);
+	} else {
+		env_lock(b);
+		env_lock(a);
+	}
+}
+
+void
+env_unlock_pair(struct Env *a, struct Env *b)
+{
+	env_unlock(a);
+	if (a != b)
+		env_unlock(b);
+}
+
 // Mark all environments in 'envs' as free, set their env_ids to 0,
 // and insert them into the env_free_list.
 // Make sure the environments are in the free list in the same order
@@ -132,6 +188,8 @@ env_init(void)
     envs[i].env_status = ENV_FREE;
     envs[i].env_runs = 0;
     envs[i].env_pgdir = NULL; 
+    envs[i].env_rq_cpu = -1;
+    __spin_initlock(&env_locks[i], "env_lock");
   }
   env_free_list = envs;
 	// Per-CPU part of the initialization
@@ -228,12 +286,22 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	int r;
 	struct Env *e;
 
-	if (!(e = env_free_list))
+	spin_lock(&env_table_lock);
+	if (!(e = env_free_list)) {
+		spin_unlock(&env_table_lock);
 		return -E_NO_FREE_ENV;
+	}
 
 	// Allocate and set up the page directory for this environment.
-	if ((r = env_setup_vm(e)) < 0)
+	// Hold e's lock until it has its new env_id and status, so a
+	// lock-free system call that raced with the slot's previous
+	// owner sees a consistent slot.
+	env_lock(e);
+	if ((r = env_setup_vm(e)) < 0) {
+		env_unlock(e);
+		spin_unlock(&env_table_lock);
 		return r;
+	}
 
 	// Generate an env_id for this environment.
 	generation = (e->env_id + (1 << ENVGENSHIFT)) & ~(NENV - 1);
@@ -246,6 +314,9 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 	e->env_type = ENV_TYPE_USER;
 	e->env_status = ENV_RUNNABLE;
 	e->env_runs = 0;
+	e->env_priority = ENV_PRIO_NORMAL;
+	e->env_prio_boost = 0;
+	e->env_prio_adj = 0;
 
 	// Clear out all the saved register state,
 	// to prevent the register values
@@ -276,10 +347,19 @@ env_alloc(struct Env **newenv_store, envid_t parent_id)
 
 	// Also clear the IPC receiving flag.
 	e->env_ipc_recving = 0;
+	e->env_ipc_senders = e->env_ipc_senders_tail = NULL;
+	e->env_ipc_send_next = e->env_ipc_send_to = NULL;
+	e->env_ipc_waitfor = 0;
+	e->env_ipc_calling = 0;
+	e->env_ipc_callers = e->env_ipc_caller_next = NULL;
+	e->env_ipc_caller_pprev = NULL;
 
 	// commit the allocation
 	env_free_list = e->env_link;
+	env_unlock(e);
+	spin_unlock(&env_table_lock);
 	*newenv_store = e;
+	sched_enqueue(e);
 
 	// cprintf("[%08x] new env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
 	return 0;
@@ -432,6 +512,10 @@ env_create(uint8_t *binary, enum EnvType type)
     e->env_tf.tf_eflags |=  FL_IOPL_MASK; 
   }  
   e->env_type = type;
+  // the file and network servers sit on everyone's I/O path
+  if(type == ENV_TYPE_FS || type == ENV_TYPE_NS){
+    sched_setprio(e, ENV_PRIO_HIGH);
+  }
   load_icode(e, binary); 
 }
 
@@ -454,6 +538,14 @@ env_free(struct Env *e)
 	// Note the environment's demise.
 	// cprintf("[%08x] free env %08x\n", curenv ? curenv->env_id : 0, e->env_id);
 
+	// Keep lock-free system calls out of the address space while
+	// we tear it down.
+	sched_dequeue(e);
+	ipc_cancel(e);
+	chan_cancel(e);
+	timer_cancel(e);
+	env_lock(e);
+
 	// Flush all mapped pages in the user portion of the address space
 	static_assert(UTOP % PTSIZE == 0);
 	for (pdeno = 0; pdeno < PDX(UTOP); pdeno++) {
@@ -481,11 +573,14 @@ env_free(struct Env *e)
 	pa = PADDR(e->env_pgdir);
 	e->env_pgdir = 0;
 	page_decref(pa2page(pa));
+	e->env_status = ENV_FREE;
+	env_unlock(e);
 
 	// return the environment to the free list
-	e->env_status = ENV_FREE;
+	spin_lock(&env_table_lock);
 	e->env_link = env_free_list;
 	env_free_list = e;
+	spin_unlock(&env_table_lock);
 }
 
 //
@@ -563,13 +658,35 @@ env_run(struct Env *e)
 	//	e->env_tf to sensible values.
 
 	// LAB 3: Your code here.
-  if(curenv != NULL && curenv->env_status == ENV_RUNNING){
+  uint64_t now;
+
+  if(curenv != NULL && curenv != e && curenv->env_status == ENV_RUNNING){
     curenv->env_status = ENV_RUNNABLE;  
+    sched_enqueue(curenv);
   }
 
+  // start a new time slice when switching, or when the last one is
+  // over, and arm the LAPIC timer for whatever comes first: the end of
+  // the slice or the next kernel timer
+  now = time_nsec();
+  if(curenv != e || now >= thiscpu->cpu_quantum_end){
+    thiscpu->cpu_quantum_end = now + SCHED_QUANTUM_NSEC;
+  }
+  timer_program(thiscpu->cpu_quantum_end);
+
+  sched_dequeue(e);
+  // the IPC boost and any levels gained waiting last one slice
+  e->env_prio_boost = 0;
+  if(e->env_prio_adj > 0){
+    e->env_prio_adj = 0;
+  }
   curenv = e;
   curenv->env_status = ENV_RUNNING;
   curenv->env_runs ++;
+  // Reload even if this CPU is already on e's page directory: with no
+  // TLB shootdown, this is what drops user entries another CPU has
+  // since unmapped.  The kernel's mappings are global (see
+  // boot_map_region), so only the user entries are flushed.
   lcr3(PADDR(curenv->env_pgdir));
   
   unlock_kernel();  
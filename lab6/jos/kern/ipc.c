@@ -0,0 +1,347 @@
+// Kernel side of inter-environment communication: moving a message
+// (and optionally a page) from a sender to a receiver blocked in
+// sys_ipc_recv, the FIFO queues of senders blocked in sys_ipc_send
+// waiting for a receiver to get there, and the direct switches that
+// make sys_ipc_call and sys_ipc_reply_wait cheap.
+//
+// The wait queues are protected by the big kernel lock, which every
+// IPC system call holds.  The address spaces and IPC fields of the
+// two environments involved in a transfer are also protected by
+// their env locks, since page_alloc can run without the big kernel
+// lock.
+
+#include <inc/error.h>
+#include <inc/assert.h>
+#include <inc/string.h>
+
+#include <kern/env.h>
+#include <kern/pmap.h>
+#include <kern/sched.h>
+#include <kern/ipc.h>
+#include <kern/timer.h>
+
+// Turn the single page of the classic IPC system calls into a page
+// list: fill in pg[0] with srcva and perm and return 1, or return 0
+// if srcva is at or above UTOP, meaning no page is being sent.
+int
+ipc_page_list(struct IpcPage *pg, void *srcva, unsigned perm)
+{
+	if (srcva >= (void *) UTOP)
+		return 0;
+	pg->ip_va = srcva;
+	pg->ip_perm = perm;
+	return 1;
+}
+
+// Check that 'src' may send the 'npages' pages in 'pages'.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if a page's address is >= UTOP or not page-aligned.
+//	-E_INVAL if a page's perm is inappropriate (see sys_page_alloc).
+//	-E_INVAL if a page is not mapped in src's address space.
+//	-E_INVAL if (perm & PTE_W), but the page is read-only in src's
+//		address space.
+int
+ipc_check_send(struct Env *src, const struct IpcPage *pages, int npages)
+{
+	pte_t *pte;
+	int i, perm;
+
+	for (i = 0; i < npages; i++) {
+		perm = pages[i].ip_perm;
+		if (pages[i].ip_va >= (void *) UTOP || PGOFF(pages[i].ip_va))
+			return -E_INVAL;
+		if ((perm & (PTE_U | PTE_P)) != (PTE_U | PTE_P) ||
+		    (perm & ~PTE_SYSCALL))
+			return -E_INVAL;
+		if (!page_lookup(src->env_pgdir, pages[i].ip_va, &pte))
+			return -E_INVAL;
+		if ((perm & PTE_W) && !(*pte & PTE_W))
+			return -E_INVAL;
+	}
+	return 0;
+}
+
+// Check a receive window of 'npages' pages at 'dstva'.  A dstva at or
+// above UTOP means no pages are wanted.
+// Returns 0 if the window is valid, -E_INVAL if not.
+int
+ipc_check_window(void *dstva, int npages)
+{
+	if (dstva >= (void *) UTOP)
+		return 0;
+	if (PGOFF(dstva) || npages < 0 || npages > IPC_MAXPAGES ||
+	    (uintptr_t) dstva + npages * PGSIZE > UTOP)
+		return -E_INVAL;
+	return 0;
+}
+
+// Copy the struct IpcVec at user address 'uvec' into 'vec', checking
+// the page count and receive window.
+// Returns 0 on success, -E_FAULT if e can't read uvec, -E_INVAL if
+// the counts or the window are out of range.
+int
+ipc_copyin_vec(struct Env *e, struct IpcVec *vec, const struct IpcVec *uvec)
+{
+	if (user_mem_check(e, uvec, sizeof(*uvec), PTE_U) < 0)
+		return -E_FAULT;
+	memcpy(vec, uvec, sizeof(*vec));
+	if (vec->iv_npages < 0 || vec->iv_npages > IPC_MAXPAGES)
+		return -E_INVAL;
+	if (vec->iv_dstva >= (void *) UTOP)
+		vec->iv_dstnpages = 0;
+	return ipc_check_window(vec->iv_dstva, vec->iv_dstnpages);
+}
+
+// Set e up to receive a message, mapping up to 'npages' pages at
+// 'dstva', and only from environment 'waitfor' if that is non-null.
+// In that case e goes on waitfor's list of callers, so that
+// ipc_cancel can fail the wait if waitfor goes away.  The caller holds
+// e's env lock.
+void
+ipc_recv_prepare(struct Env *e, void *dstva, int npages, struct Env *waitfor)
+{
+	e->env_ipc_recving = true;
+	e->env_ipc_dstva = dstva;
+	e->env_ipc_dstnpages = dstva < (void *) UTOP ? npages : 0;
+	e->env_ipc_from = 0;
+	e->env_ipc_waitfor = 0;
+	if (waitfor) {
+		assert(e->env_ipc_caller_pprev == NULL);
+		e->env_ipc_waitfor = waitfor->env_id;
+		e->env_ipc_caller_next = waitfor->env_ipc_callers;
+		if (e->env_ipc_caller_next)
+			e->env_ipc_caller_next->env_ipc_caller_pprev =
+				&e->env_ipc_caller_next;
+		e->env_ipc_caller_pprev = &waitfor->env_ipc_callers;
+		waitfor->env_ipc_callers = e;
+	}
+}
+
+// Stop e receiving, taking it off the list of callers it is on, if
+// any.  The caller holds e's env lock.
+void
+ipc_recv_done(struct Env *e)
+{
+	e->env_ipc_recving = 0;
+	e->env_ipc_waitfor = 0;
+	if (e->env_ipc_caller_pprev) {
+		*e->env_ipc_caller_pprev = e->env_ipc_caller_next;
+		if (e->env_ipc_caller_next)
+			e->env_ipc_caller_next->env_ipc_caller_pprev =
+				e->env_ipc_caller_pprev;
+		e->env_ipc_caller_next = NULL;
+		e->env_ipc_caller_pprev = NULL;
+	}
+}
+
+// Returns true if 'dst' is blocked receiving and accepts a message
+// from 'src' right now.  An environment in sys_ipc_call receives only
+// once its own message has been taken, and then only the reply from
+// the environment it called.
+bool
+ipc_recv_ready(struct Env *dst, struct Env *src)
+{
+	return dst->env_ipc_recving && !dst->env_ipc_from &&
+		dst->env_ipc_send_to == NULL &&
+		(!dst->env_ipc_waitfor || dst->env_ipc_waitfor == src->env_id);
+}
+
+// Deliver a message from 'src' to 'dst', which must be blocked
+// receiving.  As many of the 'npages' pages in 'pages' as fit in dst's
+// receive window are mapped there, page i at env_ipc_dstva + i*PGSIZE.
+// On success dst's IPC fields are filled in and it no longer accepts
+// messages, but it is not woken up; see ipc_wake.  The caller holds
+// both env locks.
+//
+// Returns 0 on success, < 0 on error.  Errors are those of
+// ipc_check_send, and:
+//	-E_NO_MEM if there's not enough memory for the page tables to
+//		map the pages in dst's address space.  dst's receive window
+//		is left as it was.
+int
+ipc_transfer(struct Env *src, struct Env *dst, uint32_t value,
+	     const struct IpcPage *pages, int npages)
+{
+	int i, n, r;
+
+	assert(dst->env_ipc_recving);
+	if ((r = ipc_check_send(src, pages, npages)) < 0)
+		return r;
+
+	// Allocate the page tables for the whole window first, so that
+	// once we start replacing dst's mappings nothing can fail.
+	n = MIN(npages, dst->env_ipc_dstnpages);
+	for (i = 0; i < n; i++)
+		if (!pgdir_walk(dst->env_pgdir,
+				dst->env_ipc_dstva + i * PGSIZE, 1))
+			return -E_NO_MEM;
+	for (i = 0; i < n; i++) {
+		r = page_insert(dst->env_pgdir,
+				page_lookup(src->env_pgdir, pages[i].ip_va, NULL),
+				dst->env_ipc_dstva + i * PGSIZE,
+				pages[i].ip_perm);
+		assert(r == 0);
+	}
+	dst->env_ipc_perm = n ? pages[0].ip_perm : 0;
+	dst->env_ipc_npages = n;
+
+	ipc_recv_done(dst);
+	dst->env_ipc_from = src->env_id;
+	timer_cancel(dst);
+	dst->env_ipc_value = value;
+	return 0;
+}
+
+// Make an environment blocked in an IPC system call runnable again,
+// returning 'ret' from that system call.
+void
+ipc_wake(struct Env *e, int32_t ret)
+{
+	e->env_tf.tf_regs.reg_eax = ret;
+	e->env_status = ENV_RUNNABLE;
+	e->env_prio_boost = 1;	// favour envs that just got their IPC
+	sched_woken(e);
+	sched_enqueue(e);
+}
+
+// Fail the IPC system call environment e is blocked in with error
+// 'r', dropping the receive set up by sys_ipc_call, if any.
+static void
+ipc_abort(struct Env *e, int32_t r)
+{
+	ipc_recv_done(e);
+	e->env_ipc_calling = 0;
+	timer_cancel(e);
+	ipc_wake(e, r);
+}
+
+// Fail the IPC receive environment e is blocked in because its
+// timeout expired (see kern/timer.c).
+void
+ipc_timeout(struct Env *e)
+{
+	ipc_abort(e, -E_TIMEOUT);
+}
+
+// Run an environment blocked in an IPC system call right now, on this
+// CPU, returning 'ret' from that system call.  Used instead of
+// ipc_wake when the current environment has just blocked waiting for
+// e, so that a call or reply hands the CPU straight to the other side
+// without a trip through the run queues.
+void
+ipc_switch(struct Env *e, int32_t ret)
+{
+	e->env_tf.tf_regs.reg_eax = ret;
+	env_run(e);
+}
+
+// Queue 'src' at the tail of dst's sender queue with its pending
+// message, and block it.  The caller must then give up the CPU; src
+// resumes when a receiver takes the message (see ipc_recv_pending) or
+// dst goes away (see ipc_cancel).
+void
+ipc_block_sender(struct Env *src, struct Env *dst, uint32_t value,
+		 const struct IpcPage *pages, int npages)
+{
+	assert(src->env_ipc_send_to == NULL);
+	assert(npages <= IPC_MAXPAGES);
+
+	src->env_ipc_send_value = value;
+	memmove(src->env_ipc_send_pages, pages, npages * sizeof(*pages));
+	src->env_ipc_send_npages = npages;
+	src->env_ipc_send_to = dst;
+	src->env_ipc_send_next = NULL;
+	if (dst->env_ipc_senders_tail)
+		dst->env_ipc_senders_tail->env_ipc_send_next = src;
+	else
+		dst->env_ipc_senders = src;
+	dst->env_ipc_senders_tail = src;
+
+	sched_dequeue(src);
+	src->env_status = ENV_NOT_RUNNABLE;
+}
+
+// Pop the first sender off dst's sender queue.
+static struct Env *
+ipc_pop_sender(struct Env *dst)
+{
+	struct Env *src;
+
+	if ((src = dst->env_ipc_senders) == NULL)
+		return NULL;
+	dst->env_ipc_senders = src->env_ipc_send_next;
+	if (dst->env_ipc_senders == NULL)
+		dst->env_ipc_senders_tail = NULL;
+	src->env_ipc_send_next = NULL;
+	src->env_ipc_send_to = NULL;
+	return src;
+}
+
+// Called when 'dst' starts receiving: hand it the message of the
+// first queued sender, in FIFO order, and wake that sender.  A sender
+// blocked in sys_ipc_call is not woken but left waiting for its reply.
+// A sender whose message can no longer be delivered (say, its page was
+// unmapped while it waited) is woken with the error and the next one
+// is tried.
+//
+// Returns true if a message was delivered, false if no sender was
+// waiting and dst must block.
+bool
+ipc_recv_pending(struct Env *dst)
+{
+	struct Env *src;
+	int r;
+
+	while ((src = ipc_pop_sender(dst)) != NULL) {
+		env_lock_pair(src, dst);
+		r = ipc_transfer(src, dst, src->env_ipc_send_value,
+				 src->env_ipc_send_pages,
+				 src->env_ipc_send_npages);
+		env_unlock_pair(src, dst);
+		if (r < 0) {
+			ipc_abort(src, r);
+			continue;
+		}
+		if (src->env_ipc_calling)
+			src->env_ipc_calling = 0;
+		else
+			ipc_wake(src, 0);
+		return true;
+	}
+	return false;
+}
+
+// Detach environment e from IPC wait queues before it is freed: take
+// it off the queue of the receiver it is blocked sending to, and off
+// the list of callers of the environment it is waiting for a reply
+// from, and fail the sends of everyone blocked sending to it, or
+// waiting for its reply to a sys_ipc_call, with -E_BAD_ENV.
+void
+ipc_cancel(struct Env *e)
+{
+	struct Env *dst, *prev, *src;
+
+	if ((dst = e->env_ipc_send_to) != NULL) {
+		prev = NULL;
+		for (src = dst->env_ipc_senders; src != e; src = src->env_ipc_send_next)
+			prev = src;
+		if (prev)
+			prev->env_ipc_send_next = e->env_ipc_send_next;
+		else
+			dst->env_ipc_senders = e->env_ipc_send_next;
+		if (dst->env_ipc_senders_tail == e)
+			dst->env_ipc_senders_tail = prev;
+		e->env_ipc_send_next = NULL;
+		e->env_ipc_send_to = NULL;
+	}
+
+	if (e->env_ipc_recving)
+		ipc_recv_done(e);
+
+	while ((src = ipc_pop_sender(e)) != NULL)
+		ipc_abort(src, -E_BAD_ENV);
+
+	while ((src = e->env_ipc_callers) != NULL)
+		ipc_abort(src, -E_BAD_ENV);
+}
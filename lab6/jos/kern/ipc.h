@@ -0,0 +1,28 @@
+#ifndef JOS_KERN_IPC_H
+#define JOS_KERN_IPC_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+
+int	ipc_page_list(struct IpcPage *pg, void *srcva, unsigned perm);
+int	ipc_check_send(struct Env *src, const struct IpcPage *pages, int npages);
+int	ipc_check_window(void *dstva, int npages);
+int	ipc_copyin_vec(struct Env *e, struct IpcVec *vec,
+		       const struct IpcVec *uvec);
+void	ipc_recv_prepare(struct Env *e, void *dstva, int npages,
+			 struct Env *waitfor);
+void	ipc_recv_done(struct Env *e);
+bool	ipc_recv_ready(struct Env *dst, struct Env *src);
+int	ipc_transfer(struct Env *src, struct Env *dst, uint32_t value,
+		     const struct IpcPage *pages, int npages);
+void	ipc_wake(struct Env *e, int32_t ret);
+void	ipc_switch(struct Env *e, int32_t ret) __attribute__((noreturn));
+void	ipc_block_sender(struct Env *src, struct Env *dst, uint32_t value,
+			 const struct IpcPage *pages, int npages);
+bool	ipc_recv_pending(struct Env *dst);
+void	ipc_timeout(struct Env *e);
+void	ipc_cancel(struct Env *e);
+
+#endif /* !JOS_KERN_IPC_H */
@@ -9,6 +9,7 @@
 #include <inc/x86.h>
 #include <kern/pmap.h>
 #include <kern/cpu.h>
+#include <kern/time.h>
 
 // Local APIC registers, divided by 4 for use as uint32_t[] indices.
 #define ID      (0x0020/4)   // ID
@@ -45,6 +46,8 @@
 physaddr_t lapicaddr;        // Initialized in mpconfig.c
 volatile uint32_t *lapic;
 
+static uint32_t lapic_timer_khz;	// Timer counts per ms
+
 static void
 lapicw(int index, int value)
 {
@@ -65,13 +68,14 @@ lapic_init(void)
 	// Enable local APIC; set spurious interrupt vector.
 	lapicw(SVR, ENABLE | (IRQ_OFFSET + IRQ_SPURIOUS));
 
-	// The timer repeatedly counts down at bus frequency
-	// from lapic[TICR] and then issues an interrupt.  
-	// If we cared more about precise timekeeping,
-	// TICR would be calibrated using an external time source.
+	// The timer counts down once at bus frequency from lapic[TICR]
+	// and then issues an interrupt.  It stays stopped until the
+	// scheduler arms it for the next deadline (see
+	// lapic_timer_oneshot); the rate is calibrated against the TSC
+	// in time_init.
 	lapicw(TDCR, X1);
-	lapicw(TIMER, PERIODIC | (IRQ_OFFSET + IRQ_TIMER));
-	lapicw(TICR, 10000000); 
+	lapicw(TIMER, IRQ_OFFSET + IRQ_TIMER);
+	lapicw(TICR, 0);
 
 	// Leave LINT0 of the BSP enabled so that it can get
 	// interrupts from the 8259A chip.
@@ -119,6 +123,44 @@ cpunum(void)
 	return 0;
 }
 
+// Measure the timer's rate against the TSC.  Called once, on the boot
+// CPU, once the TSC has been calibrated; all CPUs share a bus clock.
+void
+lapic_timer_calibrate(void)
+{
+	uint64_t end;
+
+	if (!lapic)
+		return;
+
+	lapicw(TIMER, MASKED | (IRQ_OFFSET + IRQ_TIMER));
+	lapicw(TICR, 0xffffffff);
+	end = read_tsc() + 10 * (uint64_t) timeinfo->ti_tsc_per_msec;
+	while (read_tsc() < end)
+		/* spin for 10 ms */;
+	lapic_timer_khz = (0xffffffff - lapic[TCCR]) / 10;
+	lapicw(TICR, 0);
+	lapicw(TIMER, IRQ_OFFSET + IRQ_TIMER);
+}
+
+// Make this CPU's timer interrupt once, 'nsec' nanoseconds from now,
+// or stop it if 'nsec' is 0.
+void
+lapic_timer_oneshot(uint64_t nsec)
+{
+	uint64_t count;
+
+	if (!lapic)
+		return;
+	// anything this far off is reprogrammed long before it fires
+	if (nsec > 1000000000ULL)
+		nsec = 1000000000ULL;
+	count = nsec * lapic_timer_khz / 1000000;
+	if (nsec && count == 0)
+		count = 1;
+	lapicw(TICR, count > 0xffffffff ? 0xffffffff : count);
+}
+
 // Acknowledge interrupt.
 void
 lapic_eoi(void)
@@ -173,6 +215,16 @@ lapic_startap(uint8_t apicid, uint32_t addr)
 	}
 }
 
+// Send interrupt 'vector' to the CPU with local APIC ID 'apicid'.
+void
+lapic_ipi_cpu(int apicid, int vector)
+{
+	lapicw(ICRHI, apicid << 24);
+	lapicw(ICRLO, FIXED | vector);
+	while (lapic[ICRLO] & DELIVS)
+		;
+}
+
 void
 lapic_ipi(int vector)
 {
@@ -11,6 +11,7 @@
 #include <kern/monitor.h>
 #include <kern/kdebug.h>
 #include <kern/trap.h>
+#include <kern/pmap.h>
 
 #define CMDBUF_SIZE	80	// enough for one VGA text line
 
@@ -26,6 +27,7 @@ static struct Command commands[] = {
 	{ "help", "Display this list of commands", mon_help },
 	{ "kerninfo", "Display information about the kernel", mon_kerninfo },
 	{ "backtrace", "Display backtrace information", mon_backtrace},
+	{ "zeropool", "Display pre-zeroed page pool statistics", mon_zeropool },
 };
 
 /***** Implementations of basic kernel monitor commands *****/
@@ -56,6 +58,22 @@ mon_kerninfo(int argc, char **argv, struct Trapframe *tf)
 	return 0;
 }
 
+int
+mon_zeropool(int argc, char **argv, struct Trapframe *tf)
+{
+	struct PageZeroStats st;
+	uint32_t total;
+
+	page_zero_stats(&st);
+	total = st.pz_hits + st.pz_misses;
+	cprintf("Pre-zeroed pages: %u pooled, %u zeroed while idle\n",
+		st.pz_pooled, st.pz_filled);
+	cprintf("ALLOC_ZERO: %u hits, %u misses (%u%% hit rate)\n",
+		st.pz_hits, st.pz_misses,
+		total ? (uint32_t) ((uint64_t) st.pz_hits * 100 / total) : 0);
+	return 0;
+}
+
 int
 mon_backtrace(int argc, char **argv, struct Trapframe *tf)
 {
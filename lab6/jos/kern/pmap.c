@@ -10,6 +10,8 @@
 #include <kern/kclock.h>
 #include <kern/env.h>
 #include <kern/cpu.h>
+#include <kern/spinlock.h>
+#include <kern/time.h>
 
 // These variables are set by i386_detect_memory()
 size_t npages;			// Amount of physical memory (in pages)
@@ -18,7 +20,79 @@ static size_t npages_basemem;	// Amount of base memory (in pages)
 // These variables are set in mem_init()
 pde_t *kern_pgdir;		// Kernel's initial page directory
 struct PageInfo *pages;		// Physical page state array
-static struct PageInfo *page_free_list;	// Free list of physical pages
+static struct PageInfo *page_free_list;	// Free list of physical pages at boot
+
+// Protects the free lists.  page_alloc and page_free may be called
+// from system calls that run without the big kernel lock.
+static struct spinlock page_lock = {
+#ifdef DEBUG_SPINLOCK
+	.name = "page_lock"
+#endif
+};
+
+// Free pages are kept by a binary buddy allocator, in blocks of 2^k
+// pages aligned to 2^k pages, for k < PAGE_MAX_ORDER.  The first page
+// of a free block has pp_free set and its order in pp_order, and is on
+// page_free_area[k], linked through pp_link and pp_pprev.
+#define PAGE_MAX_ORDER	11
+
+static struct PageInfo *page_free_area[PAGE_MAX_ORDER];
+
+// Per-CPU magazines of free pages in front of the buddy allocator, so
+// that page_alloc and page_free only take page_lock once per
+// PAGE_MAG_BATCH pages.  Only the CPU a magazine belongs to touches it,
+// and the kernel runs with interrupts off, so it needs no lock.  Pages
+// in a magazine have a pp_link of NULL, like allocated ones.
+#define PAGE_MAG_SIZE	64
+#define PAGE_MAG_BATCH	(PAGE_MAG_SIZE / 2)
+
+struct PageMag {
+	int pm_count;
+	struct PageInfo *pm_pages[PAGE_MAG_SIZE];
+};
+
+static struct PageMag page_mags[NCPU];
+
+// Until mem_init's checks, which work on page_free_list directly, have
+// run, page_alloc and page_free use that list; after, the buddy
+// allocator and the magazines.
+static bool page_buddy_on;
+
+// Whether the CPU supports 4MB pages (CPUID.1:EDX.PSE), which
+// boot_map_region then uses for the kernel's static mappings.
+static bool page_pse;
+
+// Whether to mark the static mappings above UTOP global (PTE_G), if the
+// CPU supports it (CPUID.1:EDX.PGE).  They are the same in every
+// environment's page directory, so with CR4.PGE set their TLB entries
+// survive the CR3 reload in env_run.  Build with -DPAGE_GLOBAL=0 to
+// compare.
+#ifndef PAGE_GLOBAL
+#define PAGE_GLOBAL	1
+#endif
+
+static bool page_pge;
+
+// A pool of pages that idle CPUs have already zeroed (see
+// page_zero_idle), so that page_alloc(ALLOC_ZERO) -- every
+// sys_page_alloc, and so every copy-on-write fault -- can usually skip
+// the memset.  Pages in the pool are linked through pp_link and have a
+// reference count of 0.  Halted CPUs zero at most PAGE_ZERO_BATCH
+// pages each time they go idle, and stop at PAGE_ZERO_MAX pages.
+#define PAGE_ZERO_MAX	256
+#define PAGE_ZERO_BATCH	32
+
+static struct PageInfo *page_zero_list;
+static int page_zero_count;
+static struct spinlock page_zero_lock = {
+#ifdef DEBUG_SPINLOCK
+	.name = "page_zero_lock"
+#endif
+};
+
+// How often page_alloc(ALLOC_ZERO) found a zeroed page in the pool,
+// and how many pages idle CPUs have zeroed.
+static uint32_t page_zero_hits, page_zero_misses, page_zero_filled;
 
 
 // --------------------------------------------------------------
@@ -65,12 +139,14 @@ i386_detect_memory(void)
 
 static void mem_init_mp(void);
 static void boot_map_region(pde_t *pgdir, uintptr_t va, size_t size, physaddr_t pa, int perm);
+static void page_buddy_init(void);
 static void check_page_free_list(bool only_low_memory);
 static void check_page_alloc(void);
 static void check_kern_pgdir(void);
 static physaddr_t check_va2pa(pde_t *pgdir, uintptr_t va);
 static void check_page(void);
 static void check_page_installed_pgdir(void);
+static void check_page_alloc_order(void);
 
 // This simple physical memory allocator is used only while JOS is setting
 // up its virtual memory system.  page_alloc() is the real allocator.
@@ -131,7 +207,7 @@ boot_alloc(uint32_t n)
 void
 mem_init(void)
 {
-	uint32_t cr0;
+	uint32_t cr0, edx;
 	size_t n;
 
 	// Find out how much memory the machine has (npages & npages_basemem).
@@ -144,6 +220,10 @@ mem_init(void)
 	//////////////////////////////////////////////////////////////////////
 	// create initial page directory.
 	// 创建初始化的页目录
+	cpuid(1, NULL, NULL, NULL, &edx);
+	page_pse = (edx & CPUID_PSE) != 0;
+	page_pge = PAGE_GLOBAL && (edx & CPUID_PGE) != 0;
+
 	kern_pgdir = (pde_t *) boot_alloc(PGSIZE);
 	memset(kern_pgdir, 0, PGSIZE);
 	cprintf("kern_pddir 0x%x\n", kern_pgdir);
@@ -175,6 +255,11 @@ mem_init(void)
 	// LAB 3: Your code here.
   envs = (struct Env *)boot_alloc(NENV * sizeof(struct Env));  
   memset(envs, 0, NENV * sizeof(struct Env));
+
+	//////////////////////////////////////////////////////////////////////
+	// Make 'timeinfo' point to the page exported to users at UTIME.
+	timeinfo = (struct TimeInfo *)boot_alloc(PGSIZE);
+	memset(timeinfo, 0, PGSIZE);
   
 	//////////////////////////////////////////////////////////////////////
 	// Now that we've allocated the initial kernel data structures, we set
@@ -215,7 +300,16 @@ mem_init(void)
 	//    - the new image at UENVS  -- kernel R, user R
 	//    - envs itself -- kernel RW, user NONE
 	// LAB 3: Your code here.
-  boot_map_region(kern_pgdir, UENVS, PTSIZE, PADDR(envs), PTE_U);  
+	// Only map the envs array itself, to leave room for the time page
+	// at the top of the region.
+	static_assert(NENV * sizeof(struct Env) <= UTIME - UENVS);
+  boot_map_region(kern_pgdir, UENVS, ROUNDUP(NENV * sizeof(struct Env), PGSIZE),
+                  PADDR(envs), PTE_U);  
+
+	//////////////////////////////////////////////////////////////////////
+	// Map the time page read-only by the user at UTIME
+	// (ie. perm = PTE_U | PTE_P).
+  boot_map_region(kern_pgdir, UTIME, PGSIZE, PADDR(timeinfo), PTE_U);
 
 	//////////////////////////////////////////////////////////////////////
 	// Use the physical memory that 'bootstack' refers to as the kernel
@@ -239,7 +333,9 @@ mem_init(void)
 	// we just set up the mapping anyway.
 	// Permissions: kernel RW, user NONE
 	// Your code goes here:
-  boot_map_region(kern_pgdir, KERNBASE, 0xffffffff-KERNBASE, 0, PTE_W);
+	// The window is a whole number of 4MB pages, which boot_map_region
+	// maps with large PDEs when the CPU supports them.
+  boot_map_region(kern_pgdir, KERNBASE, (size_t) -KERNBASE, 0, PTE_W);
 	cprintf("boot_map_region KERNBASE SUCCESS\n");
 	
 	// Initialize the SMP-related parts of the memory map
@@ -255,6 +351,7 @@ mem_init(void)
 	//
 	// If the machine reboots at this point, you've probably set up your
 	// kern_pgdir wrong.
+	mem_init_percpu();
 	lcr3(PADDR(kern_pgdir));
 
 	check_page_free_list(0);
@@ -268,6 +365,9 @@ mem_init(void)
 
 	// Some more checks, only possible after kern_pgdir is installed.
 	check_page_installed_pgdir();
+
+	page_buddy_init();
+	check_page_alloc_order();
 }
 
 // Modify mappings in kern_pgdir to support SMP
@@ -361,6 +461,156 @@ page_init(void)
 
 	
 
+}
+
+// Remove the free block headed by pp from its buddy free list.
+static void
+buddy_remove(struct PageInfo *pp)
+{
+	*pp->pp_pprev = pp->pp_link;
+	if (pp->pp_link)
+		pp->pp_link->pp_pprev = pp->pp_pprev;
+	pp->pp_link = NULL;
+	pp->pp_pprev = NULL;
+	pp->pp_free = 0;
+}
+
+// Put the free block of 2^order pages headed by pp on its free list.
+static void
+buddy_push(struct PageInfo *pp, int order)
+{
+	pp->pp_free = 1;
+	pp->pp_order = order;
+	pp->pp_link = page_free_area[order];
+	if (pp->pp_link)
+		pp->pp_link->pp_pprev = &pp->pp_link;
+	pp->pp_pprev = &page_free_area[order];
+	page_free_area[order] = pp;
+}
+
+// Take a block of 2^order pages, splitting a larger one if need be.
+// The caller holds page_lock.
+static struct PageInfo *
+buddy_alloc(int order)
+{
+	struct PageInfo *pp;
+	int k;
+
+	for (k = order; k < PAGE_MAX_ORDER && !page_free_area[k]; k++)
+		/* do nothing */;
+	if (k == PAGE_MAX_ORDER)
+		return NULL;
+	pp = page_free_area[k];
+	buddy_remove(pp);
+	// give back the upper halves
+	while (k > order) {
+		k--;
+		buddy_push(pp + (1 << k), k);
+	}
+	return pp;
+}
+
+// Free the block of 2^order pages headed by pp, merging it with its
+// buddy for as long as that is free too.  The caller holds page_lock.
+static void
+buddy_free(struct PageInfo *pp, int order)
+{
+	size_t i = pp - pages, bi;
+
+	for (; order < PAGE_MAX_ORDER - 1; order++) {
+		bi = i ^ (1 << order);
+		if (bi >= npages || !pages[bi].pp_free ||
+		    pages[bi].pp_order != order)
+			break;
+		buddy_remove(&pages[bi]);
+		i &= ~(1 << order);
+	}
+	buddy_push(&pages[i], order);
+}
+
+// Hand the pages on the boot free list over to the buddy allocator,
+// once mem_init's checks of that list are done.
+static void
+page_buddy_init(void)
+{
+	struct PageInfo *pp;
+
+	spin_lock(&page_lock);
+	while ((pp = page_free_list) != NULL) {
+		page_free_list = pp->pp_link;
+		pp->pp_link = NULL;
+		buddy_free(pp, 0);
+	}
+	page_buddy_on = 1;
+	spin_unlock(&page_lock);
+}
+
+// Move up to PAGE_MAG_BATCH pages from the buddy allocator into mag.
+static void
+page_mag_refill(struct PageMag *mag)
+{
+	struct PageInfo *pp;
+
+	spin_lock(&page_lock);
+	while (mag->pm_count < PAGE_MAG_BATCH && (pp = buddy_alloc(0)))
+		mag->pm_pages[mag->pm_count++] = pp;
+	spin_unlock(&page_lock);
+}
+
+// Move n pages from mag back to the buddy allocator.
+static void
+page_mag_drain(struct PageMag *mag, int n)
+{
+	int i;
+
+	spin_lock(&page_lock);
+	for (i = 0; i < n; i++)
+		buddy_free(mag->pm_pages[--mag->pm_count], 0);
+	spin_unlock(&page_lock);
+}
+
+// Give the free pages cached on this CPU, and the pre-zeroed pool,
+// back to the buddy allocator, where they can merge into larger blocks
+// again.
+static void
+page_reclaim(void)
+{
+	struct PageMag *mag = &page_mags[cpunum()];
+	struct PageInfo *pp, *next;
+
+	page_mag_drain(mag, mag->pm_count);
+
+	spin_lock(&page_zero_lock);
+	pp = page_zero_list;
+	page_zero_list = NULL;
+	page_zero_count = 0;
+	spin_unlock(&page_zero_lock);
+
+	spin_lock(&page_lock);
+	for (; pp; pp = next) {
+		next = pp->pp_link;
+		pp->pp_link = NULL;
+		buddy_free(pp, 0);
+	}
+	spin_unlock(&page_lock);
+}
+
+// Take a page off the pre-zeroed pool, or return NULL if it is empty.
+static struct PageInfo *
+page_zero_pop(void)
+{
+	struct PageInfo *pp;
+
+	if (!page_zero_list)
+		return NULL;
+	spin_lock(&page_zero_lock);
+	if ((pp = page_zero_list) != NULL) {
+		page_zero_list = pp->pp_link;
+		page_zero_count--;
+		pp->pp_link = NULL;
+	}
+	spin_unlock(&page_zero_lock);
+	return pp;
 }
 
 //
@@ -380,12 +630,33 @@ page_alloc(int alloc_flags)
 {
 	// Fill this function in
 	struct PageInfo *result;
-	result = page_free_list;
-	if(result == NULL){
-		return NULL;
+	struct PageMag *mag = &page_mags[cpunum()];
+
+	if (page_buddy_on) {
+		if (alloc_flags & ALLOC_ZERO) {
+			if ((result = page_zero_pop()) != NULL) {
+				__sync_fetch_and_add(&page_zero_hits, 1);
+				return result;
+			}
+			__sync_fetch_and_add(&page_zero_misses, 1);
+		}
+		if (mag->pm_count == 0)
+			page_mag_refill(mag);
+		if (mag->pm_count == 0)
+			// Last resort: the pool is free memory too.
+			return page_zero_pop();
+		result = mag->pm_pages[--mag->pm_count];
+	} else {
+		spin_lock(&page_lock);
+		result = page_free_list;
+		if(result == NULL){
+			spin_unlock(&page_lock);
+			return NULL;
+		}
+		page_free_list = result->pp_link;
+		spin_unlock(&page_lock);
+		result->pp_link = NULL;
 	}
-	page_free_list = result->pp_link;
-	result->pp_link = NULL;
 	
 	if(alloc_flags & ALLOC_ZERO){
 		memset(page2kva(result), 0, PGSIZE);
@@ -394,6 +665,43 @@ page_alloc(int alloc_flags)
 	return result;
 }
 
+//
+// Allocates 2^order physically contiguous pages, aligned to 2^order
+// pages, for devices that DMA into buffers longer than a page and the
+// like.  Each is like a page from page_alloc: zeroed if
+// (alloc_flags & ALLOC_ZERO), and with a reference count of 0, so they
+// are freed one by one with page_free, and merge again as they are.
+// Only available once mem_init is done.
+//
+// Returns the PageInfo of the first page, or NULL if there is no free
+// block that large, even after this CPU's magazine and the pre-zeroed
+// pool have gone back to the buddy allocator.
+//
+struct PageInfo *
+page_alloc_order(int alloc_flags, int order)
+{
+	struct PageInfo *pp;
+
+	assert(page_buddy_on);
+	if (order < 0 || order >= PAGE_MAX_ORDER)
+		return NULL;
+	spin_lock(&page_lock);
+	pp = buddy_alloc(order);
+	spin_unlock(&page_lock);
+	if (!pp) {
+		// The block's missing pages may be sitting in a cache,
+		// where they can't merge; give them back and look again.
+		page_reclaim();
+		spin_lock(&page_lock);
+		pp = buddy_alloc(order);
+		spin_unlock(&page_lock);
+	}
+
+	if (pp && (alloc_flags & ALLOC_ZERO))
+		memset(page2kva(pp), 0, PGSIZE << order);
+	return pp;
+}
+
 //
 // Return a page to the free list.
 // (This function should only be called when pp->pp_ref reaches 0.)
@@ -404,24 +712,86 @@ page_free(struct PageInfo *pp)
 	// Fill this function in
 	// Hint: You may want to panic if pp->pp_ref is nonzero or
 	// pp->pp_link is not NULL.
+	struct PageMag *mag = &page_mags[cpunum()];
+
 	assert(pp->pp_ref == 0);
 	assert(pp->pp_link == NULL);
 	
+	if (page_buddy_on) {
+		if (mag->pm_count == PAGE_MAG_SIZE)
+			page_mag_drain(mag, PAGE_MAG_BATCH);
+		mag->pm_pages[mag->pm_count++] = pp;
+		return;
+	}
+	spin_lock(&page_lock);
 	pp->pp_link = page_free_list;
 	page_free_list = pp;
+	spin_unlock(&page_lock);
 }	
 
+//
+// Top up the pool of pre-zeroed pages by up to PAGE_ZERO_BATCH pages.
+// Called by sched_halt, without the big kernel lock, on a CPU that has
+// nothing better to do.
+//
+void
+page_zero_idle(void)
+{
+	struct PageInfo *pp;
+	int i;
+
+	if (!page_buddy_on)
+		return;
+	for (i = 0; i < PAGE_ZERO_BATCH && page_zero_count < PAGE_ZERO_MAX; i++) {
+		if (!(pp = page_alloc(0)))
+			break;
+		memset(page2kva(pp), 0, PGSIZE);
+		spin_lock(&page_zero_lock);
+		pp->pp_link = page_zero_list;
+		page_zero_list = pp;
+		page_zero_count++;
+		page_zero_filled++;
+		spin_unlock(&page_zero_lock);
+	}
+}
+
+// Report the pre-zeroed pool's size and counters.
+void
+page_zero_stats(struct PageZeroStats *st)
+{
+	st->pz_pooled = page_zero_count;
+	st->pz_hits = page_zero_hits;
+	st->pz_misses = page_zero_misses;
+	st->pz_filled = page_zero_filled;
+}
+
 //
 // Decrement the reference count on a page,
 // freeing it if there are no more refs.
+// The count is updated atomically, since a page may be shared between
+// address spaces that different CPUs modify concurrently.
 //
 void
 page_decref(struct PageInfo* pp)
 {
-	if (--pp->pp_ref == 0)
+	if (__sync_sub_and_fetch(&pp->pp_ref, 1) == 0)
 		page_free(pp);
 }
 
+// Turn on the paging features kern_pgdir relies on for this CPU.
+// Must run before this CPU loads kern_pgdir.
+void
+mem_init_percpu(void)
+{
+	uint32_t cr4 = rcr4();
+
+	if (page_pse)
+		cr4 |= CR4_PSE;
+	if (page_pge)
+		cr4 |= CR4_PGE;
+	lcr4(cr4);
+}
+
 // Given 'pgdir', a pointer to a page directory, pgdir_walk returns
 // a pointer to the page table entry (PTE) for linear address 'va'.
 // This requires walking the two-level page table structure.
@@ -434,6 +804,11 @@ page_decref(struct PageInfo* pp)
 //	the page is cleared,
 //	and pgdir_walk returns a pointer into the new page table page.
 //
+// If 'va' is covered by a 4MB page (a PDE with PTE_PS set, which
+// only boot_map_region creates, above UTOP), pgdir_walk returns a
+// pointer to that PDE instead.  Its address field is the start of the
+// 4MB page, not of a page table.
+//
 // Hint 1: you can turn a PageInfo * into the physical address of the
 // page it refers to with page2pa() from kern/pmap.h.
 //
@@ -464,6 +839,9 @@ pgdir_walk(pde_t *pgdir, const void *va, int create)
 			*pde = page2pa(new_page)|PTE_P|PTE_U|PTE_W;
 		}
 	}	 
+	if(*pde & PTE_PS){
+		return pde;
+	}
 	
 	
 	pte_t *pta = (pte_t *)KADDR(PTE_ADDR(*pde));
@@ -477,6 +855,14 @@ pgdir_walk(pde_t *pgdir, const void *va, int create)
 // va and pa are both page-aligned.
 // Use permission bits perm|PTE_P for the entries.
 //
+// Where va and pa are both 4MB-aligned, at least 4MB remain, and the
+// CPU supports it, a whole 4MB is mapped with one PDE (PTE_PS), which
+// needs no page table and only one TLB entry.
+//
+// Mappings above UTOP are marked global (PTE_G) when the CPU supports
+// it: every environment shares them, so a CR3 reload need not flush
+// them.
+//
 // This function is only intended to set up the ``static'' mappings
 // above UTOP. As such, it should *not* change the pp_ref field on the
 // mapped pages.
@@ -488,7 +874,18 @@ boot_map_region(pde_t *pgdir, uintptr_t va, size_t size, physaddr_t pa, int perm
 	// Fill this function in	
 	int sizeAdd = 0;
 	pte_t *new_entry = NULL;
+	if(page_pge && va >= UTOP){
+		perm |= PTE_G;
+	}
 	for(sizeAdd = 0; sizeAdd < size; sizeAdd += PGSIZE){
+		if(page_pse && va % PTSIZE == 0 && pa % PTSIZE == 0 &&
+		   size - sizeAdd >= PTSIZE && !(pgdir[PDX(va)] & PTE_P)){
+			pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+			sizeAdd += PTSIZE - PGSIZE;
+			pa += PTSIZE;
+			va += PTSIZE;
+			continue;
+		}
 		new_entry = pgdir_walk(pgdir, (void *)va, 1);
 		*new_entry = (pa | perm | PTE_P);
 		
@@ -532,7 +929,7 @@ page_insert(pde_t *pgdir, struct PageInfo *pp, void *va, int perm)
 		return -E_NO_MEM;
 	}
 	
-	pp->pp_ref++;	//这句要放在前面	
+	__sync_add_and_fetch(&pp->pp_ref, 1);	//这句要放在前面	
 	if(*entry & PTE_P){
 		page_remove(pgdir, va);
 	}	
@@ -565,7 +962,12 @@ page_lookup(pde_t *pgdir, void *va, pte_t **pte_store)
 		return NULL;
 	}
 	
-	re_page = pa2page(PTE_ADDR(*entry));
+	if(*entry & PTE_PS){
+		// the 4KB page within a 4MB one
+		re_page = pa2page(PTE_ADDR(*entry) + (PTX(va) << PTXSHIFT));
+	}else{
+		re_page = pa2page(PTE_ADDR(*entry));
+	}
 	if(pte_store != NULL){
 		*pte_store = entry ;
 	}
@@ -895,6 +1297,9 @@ check_kern_pgdir(void)
 	for (i = 0; i < n; i += PGSIZE)
 		assert(check_va2pa(pgdir, UENVS + i) == PADDR(envs) + i);
 
+	// check time page
+	assert(check_va2pa(pgdir, UTIME) == PADDR(timeinfo));
+
 	// check phys mem
 	for (i = 0; i < npages * PGSIZE; i += PGSIZE)
 		assert(check_va2pa(pgdir, KERNBASE + i) == i);
@@ -945,6 +1350,8 @@ check_va2pa(pde_t *pgdir, uintptr_t va)
 	pgdir = &pgdir[PDX(va)];
 	if (!(*pgdir & PTE_P))
 		return ~0;
+	if (*pgdir & PTE_PS)
+		return PTE_ADDR(*pgdir) + (PTX(va) << PTXSHIFT);
 	p = (pte_t*) KADDR(PTE_ADDR(*pgdir));
 	if (!(p[PTX(va)] & PTE_P))
 		return ~0;
@@ -1170,3 +1577,27 @@ check_page_installed_pgdir(void)
 
 	cprintf("check_page_installed_pgdir() succeeded!\n");
 }
+
+// Check that page_alloc_order hands out aligned blocks that don't
+// overlap, and that zeroing covers the whole block.
+static void
+check_page_alloc_order(void)
+{
+	struct PageInfo *pp0, *pp1;
+	int i, n = 1 << 3;
+
+	assert((pp0 = page_alloc_order(ALLOC_ZERO, 3)));
+	assert((pp1 = page_alloc_order(0, 3)));
+	assert((page2pa(pp0) & (n * PGSIZE - 1)) == 0);
+	assert((page2pa(pp1) & (n * PGSIZE - 1)) == 0);
+	assert(pp1 >= pp0 + n || pp0 >= pp1 + n);
+	for (i = 0; i < n * PGSIZE; i++)
+		assert(((char *) page2kva(pp0))[i] == 0);
+	for (i = 0; i < n; i++) {
+		assert(pp0[i].pp_ref == 0 && pp0[i].pp_link == NULL);
+		page_free(&pp0[i]);
+		page_free(&pp1[i]);
+	}
+	assert(page_alloc_order(0, PAGE_MAX_ORDER) == NULL);
+	cprintf("check_page_alloc_order() succeeded!\n");
+}
@@ -52,15 +52,28 @@ enum {
 };
 
 void	mem_init(void);
+void	mem_init_percpu(void);
 
 void	page_init(void);
 struct PageInfo *page_alloc(int alloc_flags);
+struct PageInfo *page_alloc_order(int alloc_flags, int order);
 void	page_free(struct PageInfo *pp);
 int	page_insert(pde_t *pgdir, struct PageInfo *pp, void *va, int perm);
 void	page_remove(pde_t *pgdir, void *va);
 struct PageInfo *page_lookup(pde_t *pgdir, void *va, pte_t **pte_store);
 void	page_decref(struct PageInfo *pp);
 
+// Counters for the pool of pages zeroed by idle CPUs.
+struct PageZeroStats {
+	uint32_t pz_pooled;	// pages in the pool now
+	uint32_t pz_hits;	// ALLOC_ZERO allocations served from it
+	uint32_t pz_misses;	// ALLOC_ZERO allocations that had to memset
+	uint32_t pz_filled;	// pages idle CPUs have zeroed
+};
+
+void	page_zero_idle(void);
+void	page_zero_stats(struct PageZeroStats *st);
+
 void	tlb_invalidate(pde_t *pgdir, void *va);
 
 void *	mmio_map_region(physaddr_t pa, size_t size);
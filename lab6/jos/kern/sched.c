@@ -4,51 +4,314 @@
 #include <kern/env.h>
 #include <kern/pmap.h>
 #include <kern/monitor.h>
+#include <kern/sched.h>
+#include <kern/timer.h>
+#include <kern/time.h>
 
-void sched_halt(void);
+void sched_halt(void) __attribute__((noreturn));
+
+// Per-CPU run queues.
+//
+// An environment is linked onto exactly one run queue while its
+// status is ENV_RUNNABLE, and onto none otherwise.  Running
+// environments are put back on the tail of the queue when they are
+// switched out (see env_run), so popping from the head gives the
+// same round-robin order the old scan of 'envs' did, in constant time.
+//
+// Each queue has one FIFO per priority level.  Under SCHED_RR every
+// environment is queued at level 0; under SCHED_PRIO the level is the
+// environment's base priority, plus one if it was just woken by IPC,
+// plus its feedback adjustment (see kern/sched.h).
+#define NRQLEVEL	(NENVPRIO + 1)
+
+int sched_policy = SCHED_POLICY;
+
+struct RunQueue {
+	struct Env *rq_head[NRQLEVEL];
+	struct Env *rq_tail[NRQLEVEL];
+	int rq_len;
+};
+
+static struct RunQueue runqs[NCPU];
+
+// The run queue level environment e should be queued at.
+static int
+runq_level(struct Env *e)
+{
+	int level;
+
+	if (sched_policy == SCHED_RR)
+		return 0;
+	level = e->env_priority + (e->env_prio_boost ? 1 : 0) +
+		e->env_prio_adj;
+	if (level < 0)
+		return 0;
+	if (level >= NRQLEVEL)
+		return NRQLEVEL - 1;
+	return level;
+}
+
+static void
+runq_push(int cpu, struct Env *e)
+{
+	struct RunQueue *rq = &runqs[cpu];
+	int level = runq_level(e);
+
+	e->env_rq_next = NULL;
+	e->env_rq_prev = rq->rq_tail[level];
+	if (rq->rq_tail[level])
+		rq->rq_tail[level]->env_rq_next = e;
+	else
+		rq->rq_head[level] = e;
+	rq->rq_tail[level] = e;
+	rq->rq_len++;
+	e->env_rq_cpu = cpu;
+	e->env_rq_level = level;
+	e->env_rq_since = time_nsec();
+}
+
+static void
+runq_remove(struct Env *e)
+{
+	struct RunQueue *rq = &runqs[e->env_rq_cpu];
+	int level = e->env_rq_level;
+
+	if (e->env_rq_prev)
+		e->env_rq_prev->env_rq_next = e->env_rq_next;
+	else
+		rq->rq_head[level] = e->env_rq_next;
+	if (e->env_rq_next)
+		e->env_rq_next->env_rq_prev = e->env_rq_prev;
+	else
+		rq->rq_tail[level] = e->env_rq_prev;
+	rq->rq_len--;
+	e->env_rq_next = e->env_rq_prev = NULL;
+	e->env_rq_cpu = -1;
+}
+
+// Return the highest non-empty level of run queue 'rq', or -1.
+static int
+runq_top(struct RunQueue *rq)
+{
+	int level;
+
+	for (level = NRQLEVEL - 1; level >= 0; level--)
+		if (rq->rq_head[level])
+			return level;
+	return -1;
+}
+
+// Pick the run queue for a runnable environment.  An environment
+// that has run before goes back to the CPU it last ran on
+// (env_cpunum), whose caches are most likely to still hold its
+// working set, even if that CPU is halted: sched_kick wakes it up.
+// New environments, and environments whose last CPU never started,
+// are queued on this CPU instead.
+static int
+sched_pick_cpu(struct Env *e)
+{
+	int cpu = e->env_cpunum;
+
+	if (e->env_runs == 0 || cpu < 0 || cpu >= ncpu ||
+	    cpus[cpu].cpu_status == CPU_UNUSED)
+		return cpunum();
+	return cpu;
+}
+
+// Halted CPUs have no periodic tick to wake them up.  Send one an
+// IPI when work is queued for it, or when the queue we just added to
+// has a backlog that a halted CPU could steal from.
+static void
+sched_kick(int cpu)
+{
+	int i;
+
+	if (cpu != cpunum() && cpus[cpu].cpu_status == CPU_HALTED) {
+		lapic_ipi_cpu(cpus[cpu].cpu_id, IRQ_OFFSET + IRQ_WAKEUP);
+		return;
+	}
+	if (runqs[cpu].rq_len < 2)
+		return;
+	for (i = 0; i < ncpu; i++)
+		if (i != cpunum() && cpus[i].cpu_status == CPU_HALTED) {
+			lapic_ipi_cpu(cpus[i].cpu_id, IRQ_OFFSET + IRQ_WAKEUP);
+			return;
+		}
+}
+
+// Put a runnable environment on the tail of a run queue, preferring
+// the CPU it last ran on.  Does nothing if it is already queued.
+void
+sched_enqueue(struct Env *e)
+{
+	int cpu;
+
+	assert(e->env_status == ENV_RUNNABLE);
+	if (e->env_rq_cpu >= 0)
+		return;
+	cpu = sched_pick_cpu(e);
+	runq_push(cpu, e);
+	sched_kick(cpu);
+}
+
+// Take an environment off whatever run queue it is on, if any.
+// Must be called before an environment leaves ENV_RUNNABLE.
+void
+sched_dequeue(struct Env *e)
+{
+	if (e->env_rq_cpu >= 0)
+		runq_remove(e);
+}
+
+// Set environment e's base priority, moving it to the matching
+// run queue level if it is queued.
+void
+sched_setprio(struct Env *e, int prio)
+{
+	int cpu = e->env_rq_cpu;
+
+	assert(prio >= ENV_PRIO_LOW && prio < NENVPRIO);
+	e->env_priority = prio;
+	if (cpu >= 0) {
+		runq_remove(e);
+		runq_push(cpu, e);
+	}
+}
+
+// Switch scheduling policy, requeueing every queued environment at
+// its level under the new policy.
+void
+sched_setpolicy(int policy)
+{
+	struct Env *e;
+	int i, cpu;
+
+	assert(policy == SCHED_RR || policy == SCHED_PRIO);
+	sched_policy = policy;
+	for (i = 0; i < NENV; i++) {
+		e = &envs[i];
+		if ((cpu = e->env_rq_cpu) < 0)
+			continue;
+		runq_remove(e);
+		runq_push(cpu, e);
+	}
+}
+
+// Environment e, running on this CPU, used up its whole time slice:
+// under SCHED_PRIO, move it down a level.
+void
+sched_slice_expired(struct Env *e)
+{
+	if (sched_policy == SCHED_PRIO && runq_level(e) > 0)
+		e->env_prio_adj--;
+}
+
+// Environment e blocked and is runnable again: forget how much CPU it
+// used before, so interactive environments get their level back.
+void
+sched_woken(struct Env *e)
+{
+	e->env_prio_adj = 0;
+}
+
+// Under SCHED_PRIO, move environments that have waited SCHED_AGE_NSEC
+// at the head of a level up one level.  Levels are visited from the
+// top so that nothing climbs more than one level per call.
+static void
+runq_age(int cpu)
+{
+	struct RunQueue *rq = &runqs[cpu];
+	struct Env *e;
+	uint64_t now;
+	int level;
+
+	if (sched_policy != SCHED_PRIO)
+		return;
+	now = time_nsec();
+	for (level = NRQLEVEL - 2; level >= 0; level--) {
+		e = rq->rq_head[level];
+		if (!e || now - e->env_rq_since < SCHED_AGE_NSEC)
+			continue;
+		runq_remove(e);
+		e->env_prio_adj++;
+		runq_push(cpu, e);
+	}
+}
+
+// Steal an environment from the peer CPU with the longest run queue,
+// provided that queue holds more than 'min' environments.  We take
+// the tail of its highest non-empty level, which is the environment
+// that would have waited longest on its own CPU.
+static struct Env *
+runq_steal(int min)
+{
+	int i, busiest = -1;
+	struct Env *e;
+	struct RunQueue *rq;
+
+	for (i = 0; i < ncpu; i++) {
+		if (i == cpunum())
+			continue;
+		if (runqs[i].rq_len > min &&
+		    (busiest < 0 || runqs[i].rq_len > runqs[busiest].rq_len))
+			busiest = i;
+	}
+	if (busiest < 0)
+		return NULL;
+
+	rq = &runqs[busiest];
+	e = rq->rq_tail[runq_top(rq)];
+	runq_remove(e);
+	return e;
+}
 
 // Choose a user environment to run and run it.
 void
 sched_yield(void)
 {
 	struct Env *idle;
+	struct Env *next;
+	struct RunQueue *rq;
+	int level;
 
-	// Implement simple round-robin scheduling.
+	// Round-robin scheduling over the per-CPU run queues.
 	//
-	// Search through 'envs' for an ENV_RUNNABLE environment in
-	// circular fashion starting just after the env this CPU was
-	// last running.  Switch to the first such environment found.
+	// Take the environment at the head of this CPU's run queue; the
+	// environment previously running here (if it is still
+	// ENV_RUNNING) goes to the tail of the queue in env_run.
+	// Under SCHED_PRIO, take the head of the highest non-empty
+	// level, and keep running the current environment if its own
+	// level is higher still.  Waiting environments age upwards
+	// first (see runq_age), so a high-level environment that keeps
+	// yielding cannot hold the CPU forever.
 	//
-	// If no envs are runnable, but the environment previously
+	// If this CPU's queue is empty, but the environment previously
 	// running on this CPU is still ENV_RUNNING, it's okay to
-	// choose that environment. Make sure curenv is not null before
-	// dereferencing it.
+	// choose that environment -- unless a peer CPU has a backlog,
+	// in which case we take some of it off its hands first.
 	//
 	// Never choose an environment that's currently running on
-	// another CPU (env_status == ENV_RUNNING). If there are
-	// no runnable environments, simply drop through to the code
-	// below to halt the cpu.
-
-	// LAB 4: Your code here.
-  int env_index;  // env index
-  int start_envi;  // previous env index
-  int i;
-
-  idle = thiscpu->cpu_env;  // current env
-  start_envi = idle? ENVX(idle->env_id) + 1 : 0;
-  
-  for(i = 0; i< NENV; i++){
-    env_index = (start_envi + i)%NENV;
-    if(envs[env_index].env_status == ENV_RUNNABLE){
-      env_run(&envs[env_index]);
-      return;
-    }
-  }
-  
-  if(idle && idle->env_status == ENV_RUNNING){
-    env_run(idle);
-  }
-  
+	// another CPU: running environments are never queued.  If there
+	// are no runnable environments, simply drop through to the code
+	// below, which tries to steal work before halting the cpu.
+	idle = curenv;
+	rq = &runqs[cpunum()];
+	runq_age(cpunum());
+
+	if ((level = runq_top(rq)) >= 0 &&
+	    !(idle && idle->env_status == ENV_RUNNING &&
+	      runq_level(idle) > level)) {
+		next = rq->rq_head[level];
+		runq_remove(next);
+		env_run(next);
+	}
+
+	if (idle && idle->env_status == ENV_RUNNING) {
+		if (level < 0 && (next = runq_steal(1)) != NULL)
+			env_run(next);
+		env_run(idle);
+	}
+
 	// sched_halt never returns
 	sched_halt();
 }
@@ -60,16 +323,22 @@ void
 sched_halt(void)
 {
 	int i;
+	struct Env *e;
+
+	// Before going idle, pull work over from the busiest peer.
+	if ((e = runq_steal(0)) != NULL)
+		env_run(e);
 
 	// For debugging and testing purposes, if there are no runnable
-	// environments in the system, then drop into the kernel monitor.
+	// environments in the system (and none sleeping on a timer), then
+	// drop into the kernel monitor.
 	for (i = 0; i < NENV; i++) {
 		if ((envs[i].env_status == ENV_RUNNABLE ||
 		     envs[i].env_status == ENV_RUNNING ||
 		     envs[i].env_status == ENV_DYING))
 			break;
 	}
-	if (i == NENV) {
+	if (i == NENV && !timer_pending()) {
 		cprintf("No runnable environments in the system!\n");
 		while (1)
 			monitor(NULL);
@@ -79,14 +348,22 @@ sched_halt(void)
 	curenv = NULL;
 	lcr3(PADDR(kern_pgdir));
 
+	// Sleep until the next kernel timer is due, or until another CPU
+	// sends us work, if no timers are armed.
+	timer_program(0);
+
 	// Mark that this CPU is in the HALT state, so that when
-	// timer interupts come in, we know we should re-acquire the
-	// big kernel lock
+	// timer interupts or wakeup IPIs come in, we know we should
+	// re-acquire the big kernel lock
 	xchg(&thiscpu->cpu_status, CPU_HALTED);
 
 	// Release the big kernel lock as if we were "leaving" the kernel
 	unlock_kernel();
 
+	// Put the idle time to use zeroing pages for page_alloc.  This
+	// runs with interrupts still off, but only a batch at a time.
+	page_zero_idle();
+
 	// Reset stack pointer, enable interrupts and then halt.
 	asm volatile (
 		"movl $0, %%ebp\n"
@@ -99,5 +376,6 @@ sched_halt(void)
 		"hlt\n"
 		"jmp 1b\n"
 	: : "a" (thiscpu->cpu_ts.ts_esp0));
+	panic("hlt loop exited");  /* mostly to placate the compiler */
 }
 
@@ -6,7 +6,44 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
+#include <inc/env.h>
+
+// Scheduling policies.  The policy a kernel boots with is chosen at
+// build time ('make DEFS=-DSCHED_POLICY=SCHED_PRIO'); an environment the
+// kernel created at boot can switch it with sys_sched_set_policy.
+//
+//  SCHED_RR	Round-robin over all runnable environments.
+//  SCHED_PRIO	Multi-level feedback queues: run the highest runnable
+//		level, round-robin within a level.  An environment's
+//		level starts at its base priority -- the file and
+//		network servers run at ENV_PRIO_HIGH -- plus one for the
+//		slice after it is woken by IPC.  It drops a level each
+//		time it uses up a whole slice, and climbs one for every
+//		SCHED_AGE_NSEC it waits on a run queue, so nothing
+//		starves.  Blocking on IPC or a timer resets it.
+#ifndef SCHED_POLICY
+#define SCHED_POLICY	SCHED_RR
+#endif
+
+// Length of a time slice.  The LAPIC timer is armed for the end of the
+// running environment's slice or the next kernel timer, whichever
+// comes first; there is no periodic tick.
+#define SCHED_QUANTUM_NSEC	10000000ULL
+
+// How long an environment waits on a run queue before SCHED_PRIO
+// moves it up a level.
+#define SCHED_AGE_NSEC		(2 * SCHED_QUANTUM_NSEC)
+
 // This function does not return.
 void sched_yield(void) __attribute__((noreturn));
 
+void sched_enqueue(struct Env *e);
+void sched_dequeue(struct Env *e);
+void sched_setprio(struct Env *e, int prio);
+void sched_setpolicy(int policy);
+void sched_slice_expired(struct Env *e);
+void sched_woken(struct Env *e);
+
+extern int sched_policy;
+
 #endif	// !JOS_KERN_SCHED_H
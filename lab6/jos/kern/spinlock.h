@@ -25,6 +25,13 @@ void spin_unlock(struct spinlock *lk);
 
 #define spin_initlock(lock)   __spin_initlock(lock, #lock)
 
+// The big kernel lock still covers most kernel work, but the page
+// allocator (page_lock), the env table (env_table_lock), each
+// environment's IPC state and page directory (env_lock()) and the
+// console (cons_lock) have their own locks, so the system calls in
+// syscall_nolock() can run without it.  Locks are acquired in that
+// order: kernel_lock, env_table_lock, env locks in envs[] order,
+// page_lock.  cons_lock is a leaf.
 extern struct spinlock kernel_lock;
 
 static inline void
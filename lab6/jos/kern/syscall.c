@@ -13,6 +13,9 @@
 #include <kern/sched.h>
 #include <kern/time.h>
 #include <kern/e1000.h>
+#include <kern/ipc.h>
+#include <kern/chan.h>
+#include <kern/timer.h>
 // Print a string to the system console.
 // The string is exactly 'len' characters long.
 // Destroys the environment on memory errors.
@@ -89,7 +92,9 @@ sys_exofork(void)
     return re;
   }
   
+  sched_dequeue(e);
   e->env_status = ENV_NOT_RUNNABLE; // status is set to ENV_NOT_RUNNABLE
+  e->env_priority = curenv->env_priority; // child inherits our priority
   e->env_tf = curenv->env_tf;       // register set is copied from the current environment
   e->env_tf.tf_regs.reg_eax = 0;    // child return 0
   
@@ -127,7 +132,20 @@ sys_env_set_status(envid_t envid, int status)
     return re;
   }
 
+  // a running env goes back on a run queue when it is switched out,
+  // so only an env that is off the CPU is queued here
+  if(e->env_status == ENV_RUNNING || e->env_status == ENV_DYING){
+    if(status == ENV_NOT_RUNNABLE && e->env_status == ENV_RUNNING){
+      e->env_status = status;
+    }
+    return 0;
+  }
+
+  sched_dequeue(e);
   e->env_status = status;
+  if(status == ENV_RUNNABLE){
+    sched_enqueue(e);
+  }
   return 0;
     
 	// panic("sys_env_set_status not implemented");
@@ -162,6 +180,53 @@ sys_env_set_trapframe(envid_t envid, struct Trapframe *tf)
 	//panic("sys_env_set_trapframe not implemented");
 }
 
+// Set envid's base scheduling priority to 'prio', one of the
+// ENV_PRIO_* values in inc/env.h.  Priorities only take effect under
+// the SCHED_PRIO scheduling policy.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if environment envid doesn't currently exist,
+//		or the caller doesn't have permission to change envid.
+//	-E_INVAL if prio is not a valid priority, or is higher than
+//		the caller's own priority.
+static int
+sys_env_set_priority(envid_t envid, int prio)
+{
+  struct Env *e;
+  int re;
+
+  if(prio < ENV_PRIO_LOW || prio >= NENVPRIO || prio > curenv->env_priority){
+    return -E_INVAL;
+  }
+
+  if((re = envid2env(envid, &e, 1))){
+    return re;
+  }
+
+  sched_setprio(e, prio);
+  return 0;
+}
+
+// Switch the scheduling policy to 'policy', SCHED_RR or SCHED_PRIO
+// (see kern/sched.h).  The policy affects every environment, so only
+// environments the kernel created at boot may change it.
+//
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_BAD_ENV if the caller was not created by the kernel.
+//	-E_INVAL if policy is not a valid policy.
+static int
+sys_sched_set_policy(int policy)
+{
+  if(curenv->env_parent_id != 0){
+    return -E_BAD_ENV;
+  }
+  if(policy != SCHED_RR && policy != SCHED_PRIO){
+    return -E_INVAL;
+  }
+  sched_setpolicy(policy);
+  return 0;
+}
+
 // Set the page fault upcall for 'envid' by modifying the corresponding struct
 // Env's 'env_pgfault_upcall' field.  When 'envid' causes a page fault, the
 // kernel will push a fault record onto the exception stack, then branch to
@@ -237,12 +302,23 @@ sys_page_alloc(envid_t envid, void *va, int perm)
     return -E_NO_MEM; 
   } 
    
+  // this runs without the big kernel lock, so e may have been freed
+  // (and its slot reused) by another CPU since envid2env
+  env_lock(e);
+  if(e->env_status == ENV_FREE || (envid && e->env_id != envid)){
+    env_unlock(e);
+    page_free(newpage);
+    return -E_BAD_ENV;
+  }
+
   // if page_insert() fails, free the page
   if((re = page_insert(e->env_pgdir, newpage, va, perm))){
+    env_unlock(e);
     page_free(newpage);
     return re;
   }
   
+  env_unlock(e);
   return 0;
   // panic("sys_page_alloc not implemented");
 }
@@ -298,22 +374,24 @@ sys_page_map(envid_t srcenvid, void *srcva,
     return -E_INVAL;
   }
    
+  env_lock_pair(srcenv, dstenv);
+
   // whether srcva is not mapped in srcenvid's address space
   if((page = page_lookup(srcenv->env_pgdir, srcva, &te)) == NULL){
-      return -E_INVAL;
+    env_unlock_pair(srcenv, dstenv);
+    return -E_INVAL;
   }
   
   // if (perm & PTE_W), but srcva is read-only
   if((perm & PTE_W) && !(*te & PTE_W)){
-     return -E_INVAL;
+    env_unlock_pair(srcenv, dstenv);
+    return -E_INVAL;
   }
   
   // if  there is no memory to allocate any necessary page table 
-  if((re = page_insert(dstenv->env_pgdir, page, dstva, perm))){
-    return re;
-  }
-  
-  return 0;
+  re = page_insert(dstenv->env_pgdir, page, dstva, perm);
+  env_unlock_pair(srcenv, dstenv);
+  return re;
   // panic("sys_page_map not implemented");
 }
 
@@ -343,7 +421,9 @@ sys_page_unmap(envid_t envid, void *va)
     return -E_INVAL;
   }
   
+  env_lock(e);
   page_remove(e->env_pgdir, va);
+  env_unlock(e);
   return 0;
   // panic("sys_page_unmap not implemented");
 }
@@ -391,53 +471,127 @@ sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
 {
 	// LAB 4: Your code here.
   struct Env *env;
-  struct PageInfo *pp;
-  int re;
-  pte_t *entry; 
-  
+  struct IpcPage pg;
+  int npg, re;
+
   // if environment envid doesn't currently exist(no need to check permissions)
   if((re = envid2env(envid, &env, 0)) < 0){
     return re;
   }
-  
-  if(!env->env_ipc_recving || env->env_ipc_from){
-    return -E_IPC_NOT_RECV;  
+  npg = ipc_page_list(&pg, srcva, perm);
+
+  // the receiver's IPC state and both address spaces are protected
+  // by the per-env locks
+  env_lock_pair(curenv, env);
+  if(!ipc_recv_ready(env, curenv)){
+    env_unlock_pair(curenv, env);
+    return -E_IPC_NOT_RECV;
   }
-  
-  if(srcva < (void *)UTOP){
-    if(PGOFF(srcva)){
-      return -E_INVAL;
-    }
-    
-    if(((perm & (PTE_U | PTE_P)) != (PTE_U|PTE_P)) || (perm & ~PTE_SYSCALL)){
-      return -E_INVAL;
-    }
-    
-    if(!(pp = page_lookup(curenv->env_pgdir, srcva, &entry))){
-      return -E_INVAL;
-    }
-    
-    if((perm & PTE_W) && !(*entry & PTE_W)){
-      return -E_INVAL;
-    }
-    if(env->env_ipc_dstva){
-      if((re = page_insert(env->env_pgdir, pp, env->env_ipc_dstva, perm)) < 0){
-        return re;
-      }
-      env->env_ipc_perm = perm;
-    }
+
+  re = ipc_transfer(curenv, env, value, &pg, npg);
+  env_unlock_pair(curenv, env);
+  if(re < 0){
+    return re;
   }
-   
-  // set the target env
-  env->env_ipc_recving = 0;
-  env->env_ipc_from = sys_getenvid();
-  env->env_ipc_value = value;
-  env->env_status = ENV_RUNNABLE;
-  env->env_tf.tf_regs.reg_eax = 0;  
-  return 0; 
+
+  // the receiver's sys_ipc_recv returns 0
+  ipc_wake(env, 0);
+  return 0;
 	// panic("sys_ipc_try_send not implemented");
 }
 
+// Send 'value' and the 'npages' pages in 'pages' to 'envid', blocking
+// until the target receives them.  The common part of sys_ipc_send
+// and sys_ipc_sendv.
+static int
+ipc_send_pages(envid_t envid, uint32_t value,
+	       const struct IpcPage *pages, int npages)
+{
+  struct Env *env;
+  int re;
+
+  if((re = envid2env(envid, &env, 0)) < 0){
+    return re;
+  }
+
+  // we could never receive our own message
+  if(env == curenv){
+    return -E_INVAL;
+  }
+
+  env_lock_pair(curenv, env);
+  if((re = ipc_check_send(curenv, pages, npages)) < 0){
+    env_unlock_pair(curenv, env);
+    return re;
+  }
+
+  if(ipc_recv_ready(env, curenv)){
+    re = ipc_transfer(curenv, env, value, pages, npages);
+    env_unlock_pair(curenv, env);
+    if(re == 0){
+      ipc_wake(env, 0);
+    }
+    return re;
+  }
+
+  // the receiver will hand our return value back in ipc_recv_pending
+  ipc_block_sender(curenv, env, value, pages, npages);
+  env_unlock_pair(curenv, env);
+  sched_yield();
+}
+
+// Send 'value' (and the page at 'srcva' with 'perm', as for
+// sys_ipc_try_send) to the target env 'envid', blocking until the
+// target receives it.  If the target is not blocked in sys_ipc_recv,
+// the caller is put to sleep on the target's queue of senders and is
+// woken, in FIFO order with any other senders, by the target's next
+// sys_ipc_recv.
+//
+// Returns 0 on success, < 0 on error.
+// Errors are those of sys_ipc_try_send other than -E_IPC_NOT_RECV, and:
+//	-E_INVAL if envid is the caller itself.
+//	-E_BAD_ENV if the target exits while we are waiting.
+static int
+sys_ipc_send(envid_t envid, uint32_t value, void *srcva, unsigned perm)
+{
+  struct IpcPage pg;
+
+  return ipc_send_pages(envid, value, &pg, ipc_page_list(&pg, srcva, perm));
+}
+
+// Block until a message arrives, mapping up to 'dstnpages' pages sent
+// with it at 'dstva'.  Give up after 'timeout' milliseconds, unless
+// 'timeout' is negative.  The common part of sys_ipc_recv,
+// sys_ipc_recvv and sys_ipc_recv_timeout; the caller has checked the
+// receive window.
+static int
+ipc_recv_pages(void *dstva, int dstnpages, int timeout)
+{
+  struct Env *env = curenv;
+
+  env_lock(env);
+  ipc_recv_prepare(env, dstva, dstnpages, NULL);
+  env_unlock(env);
+
+  // take the message of the first blocked sender, if there is one
+  if(ipc_recv_pending(env)){
+    return 0;
+  }
+
+  if(timeout == 0){
+    env_lock(env);
+    ipc_recv_done(env);
+    env_unlock(env);
+    return -E_TIMEOUT;
+  }
+  if(timeout > 0){
+    timer_add(env, timeout);
+  }
+  env->env_status = ENV_NOT_RUNNABLE;
+  sys_yield();
+	return 0;
+}
+
 // Block until a value is ready.  Record that you want to receive
 // using the env_ipc_recving and env_ipc_dstva fields of struct Env,
 // mark yourself not runnable, and then give up the CPU.
@@ -453,19 +607,289 @@ static int
 sys_ipc_recv(void *dstva)
 {
 	// LAB 4: Your code here.
-  struct Env *env = curenv;
-  
-  if(dstva < (void *)UTOP && PGOFF(dstva)){
-    return -E_INVAL;
+  int re;
+
+  if((re = ipc_check_window(dstva, 1)) < 0){
+    return re;
   }
-  
-  env->env_status = ENV_NOT_RUNNABLE;
-  env->env_ipc_recving = true;
-  env->env_ipc_dstva = dstva;   
-  env->env_ipc_from = 0;
-  sys_yield(); 
+  return ipc_recv_pages(dstva, dstva < (void *)UTOP ? 1 : 0, -1);
 	// panic("sys_ipc_recv not implemented");
-	return 0;
+}
+
+// Receive a message as sys_ipc_recv(dstva) does, but give up if none
+// has arrived within 'msec' milliseconds.  With a timeout of 0, only
+// take a message if a sender is already blocked sending to us.
+//
+// Returns 0 once a message has been received, < 0 on error.  Errors
+// are those of sys_ipc_recv, and:
+//	-E_TIMEOUT if the timeout expired first.
+static int
+sys_ipc_recv_timeout(void *dstva, uint32_t msec)
+{
+  int re;
+
+  if((re = ipc_check_window(dstva, 1)) < 0){
+    return re;
+  }
+  return ipc_recv_pages(dstva, dstva < (void *)UTOP ? 1 : 0,
+                        MIN(msec, 0x7fffffff));
+}
+
+// Send 'value' and 'pages' to 'envid', then wait for a reply from
+// 'envid' only, mapping up to 'dstnpages' pages of it at 'dstva'.
+// The common part of sys_ipc_call and sys_ipc_callv; the caller has
+// checked the receive window.
+static int
+ipc_call_pages(envid_t envid, uint32_t value,
+	       const struct IpcPage *pages, int npages,
+	       void *dstva, int dstnpages)
+{
+  struct Env *env;
+  int re;
+
+  if((re = envid2env(envid, &env, 0)) < 0){
+    return re;
+  }
+  if(env == curenv){
+    return -E_INVAL;
+  }
+
+  env_lock_pair(curenv, env);
+  if((re = ipc_check_send(curenv, pages, npages)) < 0){
+    env_unlock_pair(curenv, env);
+    return re;
+  }
+
+  // be ready for the reply before the target can run
+  ipc_recv_prepare(curenv, dstva, dstnpages, env);
+
+  if(ipc_recv_ready(env, curenv)){
+    if((re = ipc_transfer(curenv, env, value, pages, npages)) < 0){
+      ipc_recv_done(curenv);
+      env_unlock_pair(curenv, env);
+      return re;
+    }
+    curenv->env_status = ENV_NOT_RUNNABLE;
+    env_unlock_pair(curenv, env);
+    ipc_switch(env, 0);
+  }
+
+  // once the target takes our message, ipc_recv_pending leaves us
+  // blocked waiting for the reply
+  curenv->env_ipc_calling = true;
+  ipc_block_sender(curenv, env, value, pages, npages);
+  env_unlock_pair(curenv, env);
+  sched_yield();
+}
+
+// Send 'value' (and the page at 'srcva' with 'perm') to 'envid' as
+// sys_ipc_send does, then wait for the reply as sys_ipc_recv(dstva)
+// does, accepting messages from 'envid' only.  If 'envid' is already
+// blocked receiving, it gets the message and runs at once on this CPU
+// in our place, without a trip through the scheduler.
+//
+// Returns 0 once the reply has arrived, in the usual env_ipc_* fields.
+// Returns < 0 on error.  Errors are those of sys_ipc_send, and:
+//	-E_INVAL if dstva < UTOP but dstva is not page-aligned.
+static int
+sys_ipc_call(envid_t envid, uint32_t value, void *srcva, unsigned perm,
+	     void *dstva)
+{
+  struct IpcPage pg;
+  int re;
+
+  if((re = ipc_check_window(dstva, 1)) < 0){
+    return re;
+  }
+  return ipc_call_pages(envid, value, &pg, ipc_page_list(&pg, srcva, perm),
+                        dstva, dstva < (void *)UTOP ? 1 : 0);
+}
+
+// Reply with 'value' and 'pages' to 'envid', then wait for the next
+// message, mapping up to 'dstnpages' pages of it at 'dstva'.  The
+// common part of sys_ipc_reply_wait and sys_ipc_reply_waitv; the
+// caller has checked the receive window.
+static int
+ipc_reply_wait_pages(envid_t envid, uint32_t value,
+		     const struct IpcPage *pages, int npages,
+		     void *dstva, int dstnpages)
+{
+  struct Env *env;
+  int re;
+
+  if((re = envid2env(envid, &env, 0)) < 0){
+    return re;
+  }
+  if(env == curenv){
+    return -E_INVAL;
+  }
+
+  env_lock_pair(curenv, env);
+  if(!ipc_recv_ready(env, curenv)){
+    env_unlock_pair(curenv, env);
+    return -E_IPC_NOT_RECV;
+  }
+  if((re = ipc_transfer(curenv, env, value, pages, npages)) < 0){
+    env_unlock_pair(curenv, env);
+    return re;
+  }
+
+  ipc_recv_prepare(curenv, dstva, dstnpages, NULL);
+  env_unlock_pair(curenv, env);
+
+  // keep the CPU if the next request is already here
+  if(ipc_recv_pending(curenv)){
+    ipc_wake(env, 0);
+    return 0;
+  }
+
+  curenv->env_status = ENV_NOT_RUNNABLE;
+  ipc_switch(env, 0);
+}
+
+// Reply to 'envid' with 'value' (and the page at 'srcva' with 'perm')
+// and wait for the next message as sys_ipc_recv(dstva) does, in one
+// system call.  This is the server half of sys_ipc_call: unless
+// another request is already queued, we block and the environment we
+// replied to runs at once on this CPU.
+//
+// The reply is never queued.  If 'envid' is not blocked receiving a
+// message from us, nothing is sent or received and the call fails, so
+// the server can fall back to sys_ipc_try_send.
+//
+// Returns 0 once a message has been received, < 0 on error.  Errors
+// are those of sys_ipc_try_send, and:
+//	-E_INVAL if envid is the caller itself.
+//	-E_INVAL if dstva < UTOP but dstva is not page-aligned.
+static int
+sys_ipc_reply_wait(envid_t envid, uint32_t value, void *srcva, unsigned perm,
+		   void *dstva)
+{
+  struct IpcPage pg;
+  int re;
+
+  if((re = ipc_check_window(dstva, 1)) < 0){
+    return re;
+  }
+  return ipc_reply_wait_pages(envid, value, &pg, ipc_page_list(&pg, srcva, perm),
+                              dstva, dstva < (void *)UTOP ? 1 : 0);
+}
+
+// The multi-page versions of sys_ipc_send, sys_ipc_recv, sys_ipc_call
+// and sys_ipc_reply_wait.  Instead of a single page, they take a
+// struct IpcVec, which lists up to IPC_MAXPAGES pages to send, each
+// with its own permissions, and a receive window of up to
+// IPC_MAXPAGES pages at iv_dstva; sent page i is mapped at
+// iv_dstva + i*PGSIZE, for as many pages as the window holds.
+// The number of pages received is in env_ipc_npages, and
+// env_ipc_perm is the permission of the first one.
+//
+// Errors are those of the single-page versions, and:
+//	-E_FAULT if 'vec' is not readable by the caller.
+//	-E_INVAL if the page count or receive window is out of range.
+static int
+sys_ipc_sendv(envid_t envid, uint32_t value, const struct IpcVec *vec)
+{
+  struct IpcVec v;
+  int re;
+
+  if((re = ipc_copyin_vec(curenv, &v, vec)) < 0){
+    return re;
+  }
+  return ipc_send_pages(envid, value, v.iv_pages, v.iv_npages);
+}
+
+static int
+sys_ipc_recvv(const struct IpcVec *vec)
+{
+  struct IpcVec v;
+  int re;
+
+  if((re = ipc_copyin_vec(curenv, &v, vec)) < 0){
+    return re;
+  }
+  return ipc_recv_pages(v.iv_dstva, v.iv_dstnpages, -1);
+}
+
+static int
+sys_ipc_callv(envid_t envid, uint32_t value, const struct IpcVec *vec)
+{
+  struct IpcVec v;
+  int re;
+
+  if((re = ipc_copyin_vec(curenv, &v, vec)) < 0){
+    return re;
+  }
+  return ipc_call_pages(envid, value, v.iv_pages, v.iv_npages,
+                        v.iv_dstva, v.iv_dstnpages);
+}
+
+static int
+sys_ipc_reply_waitv(envid_t envid, uint32_t value, const struct IpcVec *vec)
+{
+  struct IpcVec v;
+  int re;
+
+  if((re = ipc_copyin_vec(curenv, &v, vec)) < 0){
+    return re;
+  }
+  return ipc_reply_wait_pages(envid, value, v.iv_pages, v.iv_npages,
+                              v.iv_dstva, v.iv_dstnpages);
+}
+
+// Create a shared-memory channel (see inc/chan.h) and map its ring
+// page at 'va' in the current environment with permission 'perm'.
+// The ring is shared with the peer like any other page, e.g. with
+// sys_ipc_send or by fork.
+//
+// Returns the channel number on success, < 0 on error.  Errors are:
+//	-E_INVAL if va >= UTOP, or va is not page-aligned.
+//	-E_INVAL if perm is inappropriate (see sys_page_alloc).
+//	-E_NO_MEM if there are no free channels, or no memory for the
+//		ring page or a page table.
+static int
+sys_chan_create(void *va, int perm)
+{
+  if(va >= (void *)UTOP || PGOFF(va)){
+    return -E_INVAL;
+  }
+  if(((perm & (PTE_U | PTE_P)) != (PTE_U|PTE_P)) || (perm & ~PTE_SYSCALL)){
+    return -E_INVAL;
+  }
+  return chan_create(curenv, va, perm);
+}
+
+// Block until the ring of the channel mapped at 'va' is non-empty
+// (what == CHAN_WAIT_DATA) or has room (what == CHAN_WAIT_ROOM).
+// Returns 0 once it does, < 0 on error (see chan_wait).
+static int
+sys_chan_wait(void *va, int what)
+{
+  return chan_wait(va, what);
+}
+
+// Wake whoever is blocked in sys_chan_wait on the channel mapped at
+// 'va' and can now go on, if anyone.  Returns 0 on success, < 0 on
+// error (see chan_notify).
+static int
+sys_chan_notify(void *va)
+{
+  return chan_notify(va);
+}
+
+// Block for at least 'msec' milliseconds.  The environment is not
+// runnable in the meantime; a timer wakes it up (see kern/timer.c).
+// Always returns 0.
+static int
+sys_sleep(uint32_t msec)
+{
+  if(msec == 0){
+    return 0;
+  }
+  timer_add(curenv, msec);
+  curenv->env_status = ENV_NOT_RUNNABLE;
+  sys_yield();
+  return 0;
 }
 
 // Return the current time.
@@ -489,6 +913,249 @@ sys_receive_packet(char *data_store, int *len_store){
   return e1000_receive_packet(data_store, len_store);  
 }
 
+// Transmit a frame gathered from the 'nsegs' segments in 'segs' (see
+// struct TxSeg) straight out of the caller's pages, without copying
+// it.  The pages stay pinned until the card has sent the frame, so the
+// caller may unmap them at once, but should not modify them.
+// Returns 0 on success, < 0 on error.  Errors are:
+//	-E_INVAL if nsegs is out of range, or the frame is empty, too long
+//		or split over too many pages.
+//	-E_FAULT if segs or part of the frame isn't readable by the caller.
+//	-1 if the transmit queue is full.
+static int
+sys_transmit_sg(const struct TxSeg *segs, int nsegs)
+{
+  struct TxSeg s[TX_MAXSEGS];
+  int re;
+
+  if(nsegs <= 0 || nsegs > TX_MAXSEGS){
+    return -E_INVAL;
+  }
+  if(user_mem_check(curenv, segs, nsegs * sizeof(*segs), PTE_U | PTE_P) < 0){
+    return -E_FAULT;
+  }
+  memmove(s, segs, nsegs * sizeof(*segs));
+
+  env_lock(curenv);
+  re = e1000_transmit_sg(curenv, s, nsegs);
+  env_unlock(curenv);
+  return re;
+}
+
+// Transmit up to 'npkts' frames straight out of the caller's pages, the
+// i'th being the 'pkts[i].ts_len' bytes at 'pkts[i].ts_va', with one
+// kernel entry and one update of the card's transmit tail.  The pages
+// stay pinned until sent, as with sys_transmit_sg.
+// Returns the number of frames queued, which is fewer than npkts if
+// the transmit queue filled up (0 if it was full), or < 0 on error.
+// Errors are:
+//	-E_INVAL if npkts is out of range, or the first frame is empty,
+//		too long or split over too many pages.
+//	-E_FAULT if pkts or the first frame isn't readable by the caller.
+// A bad frame after the first ends the batch early; it fails when
+// it comes first in the next call.
+static int
+sys_transmit_packets(const struct TxSeg *pkts, int npkts)
+{
+  struct TxSeg s[NET_MAXBATCH];
+  int re;
+
+  if(npkts <= 0 || npkts > NET_MAXBATCH){
+    return -E_INVAL;
+  }
+  if(user_mem_check(curenv, pkts, npkts * sizeof(*pkts), PTE_U | PTE_P) < 0){
+    return -E_FAULT;
+  }
+  memmove(s, pkts, npkts * sizeof(*pkts));
+
+  env_lock(curenv);
+  re = e1000_transmit_batch(curenv, s, npkts);
+  env_unlock(curenv);
+  return re;
+}
+
+// Receive a packet without copying it: the page the network card
+// received it into is mapped at 'va', holding a struct jif_pkt, and
+// replaces whatever was mapped there.
+// Returns the packet length on success, < 0 on error.  Errors are:
+//	-E_INVAL if va >= UTOP or va is not page-aligned.
+//	-E_NO_MEM if there's no memory for a page table or the page that
+//		replaces the received one in the receive ring.
+//	-1 if no packet is waiting.
+static int
+sys_receive_page(void *va)
+{
+  int re;
+
+  if(va >= (void *)UTOP || PGOFF(va)){
+    return -E_INVAL;
+  }
+  env_lock(curenv);
+  re = e1000_receive_page(curenv, va, PTE_U | PTE_P | PTE_W);
+  env_unlock(curenv);
+  return re;
+}
+
+// Receive up to 'npages' packets without copying them, as
+// sys_receive_page does, mapping the i'th at va + i*PGSIZE, with one
+// kernel entry and one update of the card's receive tail.  The length
+// of each is the jp_len of its struct jif_pkt.
+// Returns the number of packets received on success, < 0 on error.
+// Errors are:
+//	-E_INVAL if npages is out of range, or [va, va + npages*PGSIZE)
+//		is not page-aligned or not below UTOP.
+//	-E_NO_MEM if there's no memory for a page table or the page that
+//		replaces the first received one in the receive ring.
+//	-1 if no packet is waiting.
+static int
+sys_receive_pages(void *va, int npages)
+{
+  int re;
+
+  if(npages <= 0 || npages > NET_MAXBATCH){
+    return -E_INVAL;
+  }
+  if(va >= (void *)UTOP || PGOFF(va) ||
+     npages * PGSIZE > UTOP - (uintptr_t)va){
+    return -E_INVAL;
+  }
+  env_lock(curenv);
+  re = e1000_receive_pages(curenv, va, npages, PTE_U | PTE_P | PTE_W);
+  env_unlock(curenv);
+  return re;
+}
+
+// Block until the network card has a received packet for
+// sys_receive_packet.  The receive interrupt wakes us up.
+// Returns 0 once a packet is waiting, < 0 on error.  Errors are:
+//	-E_NOT_SUPP if the card's interrupts aren't available, in which
+//		case the caller has to poll.
+static int
+sys_receive_wait(void)
+{
+  int re;
+
+  if((re = e1000_receive_wait(curenv->env_id)) <= 0){
+    return re;
+  }
+  curenv->env_status = ENV_NOT_RUNNABLE;
+  sys_yield();
+  return 0;
+}
+
+// Returns true if system call 'syscallno' may appear in a sys_batch
+// vector.  Calls that block, switch environments or may not return
+// (and sys_batch itself) can't be batched.  That includes sys_cputs
+// and sys_env_set_trapframe, whose user_mem_assert destroys the caller
+// on a bad pointer.
+static bool
+syscall_batchable(uint32_t syscallno)
+{
+  switch(syscallno){
+  case SYS_getenvid:
+  case SYS_page_alloc:
+  case SYS_page_map:
+  case SYS_page_unmap:
+  case SYS_env_set_status:
+  case SYS_env_set_pgfault_upcall:
+  case SYS_env_set_priority:
+  case SYS_ipc_try_send:
+  case SYS_chan_notify:
+  case SYS_time_msec:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// sys_batch's copy of the caller's vector.  The calls in a batch can
+// unmap or remap the pages holding the vector itself, so the kernel
+// runs them from this copy and never touches the vector in between.
+// sys_batch runs with the big kernel lock held and batched calls never
+// block, so one copy for the whole system is enough.
+static struct BatchCall batch_calls[BATCH_MAXCALLS];
+
+// Run the 'n' system calls in 'calls' one after another in a single
+// kernel entry, storing each one's return value in its bc_ret.  Stops
+// at the first call that fails, since later calls usually depend on
+// earlier ones; a call that can't be batched fails with -E_INVAL.
+// The return values are written back once all the calls have run.
+//
+// Returns the number of calls run, including one that failed, or < 0
+// on error.  Errors are:
+//	-E_INVAL if n < 0 or n > BATCH_MAXCALLS.
+//	-E_FAULT if the caller can't write all of calls[0..n-1], before
+//		or after running them.  In the latter case the calls have
+//		run, but their return values are lost.
+static int
+sys_batch(struct BatchCall *calls, int n)
+{
+  struct BatchCall *c;
+  int i;
+
+  if(n < 0 || n > BATCH_MAXCALLS){
+    return -E_INVAL;
+  }
+  if(user_mem_check(curenv, calls, n * sizeof(*calls), PTE_U|PTE_W|PTE_P) < 0){
+    return -E_FAULT;
+  }
+  memcpy(batch_calls, calls, n * sizeof(*calls));
+
+  for(i = 0; i < n; i++){
+    c = &batch_calls[i];
+    if(!syscall_batchable(c->bc_num)){
+      c->bc_ret = -E_INVAL;
+    }else{
+      c->bc_ret = syscall(c->bc_num, c->bc_args[0], c->bc_args[1],
+                          c->bc_args[2], c->bc_args[3], c->bc_args[4]);
+    }
+    if(c->bc_ret < 0){
+      i++;
+      break;
+    }
+  }
+
+  // the calls may have changed our mappings of 'calls'
+  if(user_mem_check(curenv, calls, i * sizeof(*calls), PTE_U|PTE_W|PTE_P) < 0){
+    return -E_FAULT;
+  }
+  memcpy(calls, batch_calls, i * sizeof(*calls));
+  return i;
+}
+
+// Returns true if system call 'syscallno' may run without the big
+// kernel lock.  These calls only touch state guarded by its own lock
+// (the page allocator, the per-env locks) or read a single word, and
+// never block or switch environments, so trap() runs them in parallel
+// on all CPUs and returns straight to the caller.
+bool
+syscall_nolock(uint32_t syscallno)
+{
+  switch(syscallno){
+  case SYS_getenvid:
+  case SYS_page_alloc:
+  case SYS_time_msec:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// The C half of the sysenter fast path (see sysenter_handler in
+// kern/trapentry.S).  Runs one of the system calls that syscall_nolock
+// allows, with interrupts disabled and with neither the big kernel
+// lock nor a trapframe.  Any other call must come in through
+// int $T_SYSCALL and fails with -E_INVAL here.  An environment
+// destroyed by another CPU in the meantime is freed on its next trap.
+int32_t
+syscall_fast(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+  if(!syscall_nolock(syscallno)){
+    return -E_INVAL;
+  }
+  return syscall(syscallno, a1, a2, a3, 0, 0);
+}
+
 // Dispatches to the correct kernel function, passing the arguments.
 int32_t
 syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
@@ -537,6 +1204,9 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
   
   case SYS_env_set_pgfault_upcall:  
     return (int32_t)sys_env_set_pgfault_upcall(a1, (void *)a2); 
+
+  case SYS_env_set_priority:
+    return (int32_t)sys_env_set_priority(a1, a2);
   
   case SYS_yield: 
     sys_yield();
@@ -545,11 +1215,50 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
   case SYS_ipc_try_send:  
     return (int32_t)sys_ipc_try_send(a1, a2, (void *)a3, a4); 
   
+  case SYS_ipc_send:
+    return (int32_t)sys_ipc_send(a1, a2, (void *)a3, a4);
+
   case SYS_ipc_recv:  
     return (int32_t)sys_ipc_recv((void *)a1);
+
+  case SYS_ipc_call:
+    return (int32_t)sys_ipc_call(a1, a2, (void *)a3, a4, (void *)a5);
+
+  case SYS_ipc_reply_wait:
+    return (int32_t)sys_ipc_reply_wait(a1, a2, (void *)a3, a4, (void *)a5);
+
+  case SYS_ipc_sendv:
+    return (int32_t)sys_ipc_sendv(a1, a2, (const struct IpcVec *)a3);
+
+  case SYS_ipc_recvv:
+    return (int32_t)sys_ipc_recvv((const struct IpcVec *)a1);
+
+  case SYS_ipc_callv:
+    return (int32_t)sys_ipc_callv(a1, a2, (const struct IpcVec *)a3);
+
+  case SYS_ipc_reply_waitv:
+    return (int32_t)sys_ipc_reply_waitv(a1, a2, (const struct IpcVec *)a3);
    
+  case SYS_chan_create:
+    return (int32_t)sys_chan_create((void *)a1, a2);
+
+  case SYS_chan_wait:
+    return (int32_t)sys_chan_wait((void *)a1, a2);
+
+  case SYS_chan_notify:
+    return (int32_t)sys_chan_notify((void *)a1);
+
   case SYS_time_msec:
     return (int32_t)sys_time_msec();
+
+  case SYS_batch:
+    return (int32_t)sys_batch((struct BatchCall *)a1, a2);
+
+  case SYS_sleep:
+    return (int32_t)sys_sleep(a1);
+
+  case SYS_ipc_recv_timeout:
+    return (int32_t)sys_ipc_recv_timeout((void *)a1, a2);
   
   case SYS_transmit_packet:
     return (int32_t)sys_transmit_packet((char *)a1, a2);
@@ -557,6 +1266,24 @@ syscall(uint32_t syscallno, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
   case SYS_receive_packet:
     return (int32_t)sys_receive_packet((char *)a1, (int *)a2);
 
+  case SYS_receive_wait:
+    return (int32_t)sys_receive_wait();
+
+  case SYS_receive_page:
+    return (int32_t)sys_receive_page((void *)a1);
+
+  case SYS_transmit_sg:
+    return (int32_t)sys_transmit_sg((const struct TxSeg *)a1, a2);
+
+  case SYS_transmit_packets:
+    return (int32_t)sys_transmit_packets((const struct TxSeg *)a1, a2);
+
+  case SYS_receive_pages:
+    return (int32_t)sys_receive_pages((void *)a1, a2);
+
+  case SYS_sched_set_policy:
+    return (int32_t)sys_sched_set_policy(a1);
+
   default:
 		return -E_INVAL;
 	}
@@ -7,5 +7,7 @@
 #include <inc/syscall.h>
 
 int32_t syscall(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5);
+bool syscall_nolock(uint32_t num);
+int32_t syscall_fast(uint32_t num, uint32_t a1, uint32_t a2, uint32_t a3);
 
 #endif /* !JOS_KERN_SYSCALL_H */
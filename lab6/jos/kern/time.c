@@ -1,26 +1,71 @@
+// The kernel clock: the TSC, calibrated at boot against the 8253/8254
+// programmable interval timer.
+
 #include <kern/time.h>
+#include <kern/cpu.h>
 #include <inc/assert.h>
+#include <inc/stdio.h>
+#include <inc/x86.h>
+
+// 8253/8254 PIT ports and input clock
+#define PIT_CH2		0x42		// Channel 2 data port
+#define PIT_MODE	0x43		// Mode/command register
+#define PIT_GATE	0x61		// Channel 2 gate and output
+#define PIT_HZ		1193182
+
+// How long to calibrate for, in ms
+#define CALIBRATE_MSEC	10
+
+struct TimeInfo *timeinfo;
+
+// Count TSC cycles over CALIBRATE_MSEC ms, timed by PIT channel 2
+// counting down in one-shot mode.
+static uint64_t
+tsc_calibrate(void)
+{
+	uint32_t latch = PIT_HZ * CALIBRATE_MSEC / 1000;
+	uint64_t start;
 
-static unsigned int ticks;
+	// gate channel 2 on, speaker off
+	outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);
+	// channel 2, lobyte/hibyte, mode 0 (interrupt on terminal count)
+	outb(PIT_MODE, 0xb0);
+	outb(PIT_CH2, latch & 0xff);
+	outb(PIT_CH2, latch >> 8);
+
+	start = read_tsc();
+	while (!(inb(PIT_GATE) & 0x20))
+		/* wait for the count to run out */;
+	return read_tsc() - start;
+}
 
 void
 time_init(void)
 {
-	ticks = 0;
+	uint64_t cycles = tsc_calibrate();
+
+	timeinfo->ti_tsc_per_msec = cycles / CALIBRATE_MSEC;
+	timeinfo->ti_tsc_boot = read_tsc();
+	if (timeinfo->ti_tsc_per_msec == 0)
+		panic("time_init: TSC calibration failed");
+	cprintf("TSC: %u kHz\n", timeinfo->ti_tsc_per_msec);
+
+	lapic_timer_calibrate();
 }
 
-// This should be called once per timer interrupt.  A timer interrupt
-// fires every 10 ms.
-void
-time_tick(void)
+// Nanoseconds since boot.
+uint64_t
+time_nsec(void)
 {
-	ticks++;
-	if (ticks * 10 < ticks)
-		panic("time_tick: time overflowed");
+	uint64_t cycles = read_tsc() - timeinfo->ti_tsc_boot;
+	uint32_t rate = timeinfo->ti_tsc_per_msec;
+
+	// split the division so that cycles * 1000000 can't overflow
+	return (cycles / rate) * 1000000 + (cycles % rate) * 1000000 / rate;
 }
 
 unsigned int
 time_msec(void)
 {
-	return ticks * 10;
+	return (read_tsc() - timeinfo->ti_tsc_boot) / timeinfo->ti_tsc_per_msec;
 }
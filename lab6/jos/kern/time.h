@@ -4,8 +4,12 @@
 # error "This is a JOS kernel header; user programs should not #include it"
 #endif
 
+#include <inc/time.h>
+
+extern struct TimeInfo *timeinfo;	// The page mapped at UTIME
+
 void time_init(void);
-void time_tick(void);
+uint64_t time_nsec(void);
 unsigned int time_msec(void);
 
 #endif /* JOS_KERN_TIME_H */
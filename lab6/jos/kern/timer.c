@@ -0,0 +1,208 @@
+// Kernel timers: a hierarchical timer wheel of environments blocked
+// until a deadline, in sys_sleep or in an IPC receive with a timeout.
+//
+// The wheel counts milliseconds of time_msec().  Level 0 has one slot
+// per millisecond for the next TW_SLOTS ms; each slot of level L > 0
+// covers TW_SLOTS^L ms.  A timer goes in the lowest level whose span
+// covers its deadline, so adding and cancelling take constant time.
+// Every TW_SLOTS ms, the level 1 slot whose time is about to come up
+// is cascaded down into level 0, and so on up the levels, so each
+// timer moves at most TW_LEVELS - 1 times before it fires.
+//
+// There is no periodic tick: the wheel is advanced to the current time
+// whenever a LAPIC timer interrupt comes in, and each CPU arms its
+// LAPIC timer for the next deadline (see timer_program).
+//
+// The wheel is protected by the big kernel lock.
+
+#include <inc/error.h>
+#include <inc/assert.h>
+
+#include <kern/env.h>
+#include <kern/cpu.h>
+#include <kern/sched.h>
+#include <kern/ipc.h>
+#include <kern/time.h>
+#include <kern/timer.h>
+
+#define TW_BITS		6
+#define TW_SLOTS	(1 << TW_BITS)
+#define TW_LEVELS	4
+// Timers further out than this are clamped to it (about 4.6 hours)
+#define TW_MAXMSEC	((1 << (TW_BITS * TW_LEVELS)) - 1)
+
+static struct Env *wheel[TW_LEVELS][TW_SLOTS];
+static uint32_t tw_now;		// Milliseconds processed so far
+static int tw_count;		// Number of armed timers
+
+// Link e into the slot for its deadline, env_timer_expire.
+static void
+tw_insert(struct Env *e)
+{
+	uint32_t delta = e->env_timer_expire - tw_now;
+	struct Env **slot;
+	int level;
+
+	for (level = 0; level < TW_LEVELS - 1; level++)
+		if (delta < (1 << (TW_BITS * (level + 1))))
+			break;
+	slot = &wheel[level][(e->env_timer_expire >> (TW_BITS * level)) &
+			     (TW_SLOTS - 1)];
+
+	e->env_timer_next = *slot;
+	if (*slot)
+		(*slot)->env_timer_pprev = &e->env_timer_next;
+	e->env_timer_pprev = slot;
+	*slot = e;
+}
+
+static void
+tw_remove(struct Env *e)
+{
+	*e->env_timer_pprev = e->env_timer_next;
+	if (e->env_timer_next)
+		e->env_timer_next->env_timer_pprev = e->env_timer_pprev;
+	e->env_timer_next = NULL;
+	e->env_timer_pprev = NULL;
+}
+
+// Arm a timer that wakes environment e, which must be about to block,
+// once at least 'msec' milliseconds have passed.  Any timer e already
+// has is replaced.
+void
+timer_add(struct Env *e, uint32_t msec)
+{
+	uint32_t now = time_msec();
+
+	timer_cancel(e);
+	// with nothing armed, there is nothing to fire on the way
+	if (tw_count == 0)
+		tw_now = now;
+
+	// the current millisecond has partly gone by already
+	e->env_timer_expire = now + MIN(msec, TW_MAXMSEC) + 1;
+	if (e->env_timer_expire - tw_now > TW_MAXMSEC)
+		e->env_timer_expire = tw_now + TW_MAXMSEC;
+	tw_insert(e);
+	tw_count++;
+}
+
+// Disarm e's timer, if it has one.
+void
+timer_cancel(struct Env *e)
+{
+	if (e->env_timer_pprev) {
+		tw_remove(e);
+		tw_count--;
+	}
+}
+
+// Returns true if any environment is waiting for a timer.
+bool
+timer_pending(void)
+{
+	return tw_count > 0;
+}
+
+// Wake an environment whose timer has fired.  An IPC receive fails
+// with -E_TIMEOUT; sys_sleep returns 0.
+static void
+timer_expire(struct Env *e)
+{
+	tw_count--;
+	if (e->env_status != ENV_NOT_RUNNABLE)
+		return;
+	if (e->env_ipc_recving) {
+		ipc_timeout(e);
+		return;
+	}
+	e->env_tf.tf_regs.reg_eax = 0;
+	e->env_status = ENV_RUNNABLE;
+	sched_woken(e);
+	sched_enqueue(e);
+}
+
+// Move the timers in a slot of a higher level down the wheel.
+static void
+tw_cascade(int level)
+{
+	struct Env **slot, *e;
+
+	slot = &wheel[level][(tw_now >> (TW_BITS * level)) & (TW_SLOTS - 1)];
+	while ((e = *slot) != NULL) {
+		tw_remove(e);
+		tw_insert(e);
+	}
+}
+
+// Advance the wheel by one millisecond, firing the timers then due.
+static void
+tw_tick(void)
+{
+	struct Env **slot, *e;
+	int level;
+
+	tw_now++;
+	for (level = 1; level < TW_LEVELS; level++) {
+		if (tw_now & ((1 << (TW_BITS * level)) - 1))
+			break;
+		tw_cascade(level);
+	}
+
+	slot = &wheel[0][tw_now & (TW_SLOTS - 1)];
+	while ((e = *slot) != NULL) {
+		tw_remove(e);
+		timer_expire(e);
+	}
+}
+
+// Fire all the timers that are due.  Called on timer interrupts.
+void
+timer_run(void)
+{
+	uint32_t now = time_msec();
+
+	while (tw_count > 0 && (int32_t) (now - tw_now) > 0)
+		tw_tick();
+	if (tw_count == 0)
+		tw_now = now;
+}
+
+// The time_msec() at which the wheel next needs attention, or 0 if no
+// timers are armed: either the next deadline in level 0 or the next
+// cascade, whichever comes first.
+static uint32_t
+timer_next(void)
+{
+	uint32_t t;
+
+	if (tw_count == 0)
+		return 0;
+	for (t = tw_now + 1; t & (TW_SLOTS - 1); t++)
+		if (wheel[0][t & (TW_SLOTS - 1)])
+			return t;
+	return t;
+}
+
+// Arm this CPU's LAPIC timer for the next timer deadline or for
+// 'until', a time_nsec() value, whichever comes first.  With 'until'
+// 0 and no timers armed, the LAPIC timer is stopped.
+void
+timer_program(uint64_t until)
+{
+	uint64_t at = until, now;
+	uint32_t next = timer_next();
+
+	if (next && (!at || (uint64_t) next * 1000000 < at))
+		at = (uint64_t) next * 1000000;
+	if (at == thiscpu->cpu_timer_at)
+		return;
+
+	thiscpu->cpu_timer_at = at;
+	if (!at) {
+		lapic_timer_oneshot(0);
+		return;
+	}
+	now = time_nsec();
+	lapic_timer_oneshot(at > now ? at - now : 1);
+}
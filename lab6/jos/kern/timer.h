@@ -0,0 +1,15 @@
+#ifndef JOS_KERN_TIMER_H
+#define JOS_KERN_TIMER_H
+#ifndef JOS_KERNEL
+# error "This is a JOS kernel header; user programs should not #include it"
+#endif
+
+#include <inc/env.h>
+
+void	timer_add(struct Env *e, uint32_t msec);
+void	timer_cancel(struct Env *e);
+bool	timer_pending(void);
+void	timer_run(void);
+void	timer_program(uint64_t until);
+
+#endif /* !JOS_KERN_TIMER_H */
@@ -14,9 +14,14 @@
 #include <kern/cpu.h>
 #include <kern/spinlock.h>
 #include <kern/time.h>
+#include <kern/timer.h>
+#include <kern/e1000.h>
 
 static struct Taskstate ts;
 
+// Fast system call entry point (see trapentry.S)
+extern void sysenter_handler(void);
+
 /* For debugging, so print_trapframe can distinguish between printing
  * a saved trapframe and printing the current trapframe and print some
  * additional information in the latter case.
@@ -100,6 +105,10 @@ trap_init(void)
   void irq_spurious_handler();
   void irq_ide_handler();
   void irq_error_handler();
+  void irq_wakeup_handler();
+  void irq_pci9_handler();
+  void irq_pci10_handler();
+  void irq_pci11_handler();
   
   // LAB 3:
   SETGATE(idt[T_DIVIDE], 0, GD_KT, divide_handler, 0); 
@@ -129,6 +138,10 @@ trap_init(void)
   SETGATE(idt[IRQ_OFFSET + IRQ_SPURIOUS], 0, GD_KT, irq_spurious_handler, 3);
   SETGATE(idt[IRQ_OFFSET + IRQ_IDE], 0, GD_KT, irq_ide_handler, 3);
   SETGATE(idt[IRQ_OFFSET + IRQ_ERROR], 0, GD_KT, irq_error_handler, 3);
+  SETGATE(idt[IRQ_OFFSET + IRQ_WAKEUP], 0, GD_KT, irq_wakeup_handler, 0);
+  SETGATE(idt[IRQ_OFFSET + 9], 0, GD_KT, irq_pci9_handler, 0);
+  SETGATE(idt[IRQ_OFFSET + 10], 0, GD_KT, irq_pci10_handler, 0);
+  SETGATE(idt[IRQ_OFFSET + 11], 0, GD_KT, irq_pci11_handler, 0);
    
   // Per-CPU setup 
 	trap_init_percpu();
@@ -163,6 +176,7 @@ trap_init_percpu(void)
 	//
 	// LAB 4: Your code here:
   int8_t cpu_i = cpunum();
+	uint32_t edx;
 	// Setup a TSS so that we get the right stack
 	// when we trap to the kernel.
   thiscpu->cpu_ts.ts_esp0 = KSTACKTOP - cpu_i * (KSTKSIZE + KSTKGAP);
@@ -178,6 +192,18 @@ trap_init_percpu(void)
 	// bottom three bits are special; we leave them 0)
 	ltr(GD_TSS0 + sizeof(struct Segdesc) * cpu_i);
 
+	// Set up the sysenter fast system call path (see trapentry.S)
+	// to enter on this CPU's kernel stack.  sysexit derives the user
+	// segments from MSR_SYSENTER_CS, which relies on GD_UT and GD_UD
+	// following GD_KT and GD_KD in the GDT.  Without SEP there are no
+	// such MSRs, and lib/syscall.c sticks to int $T_SYSCALL.
+	cpuid(1, NULL, NULL, NULL, &edx);
+	if (edx & CPUID_SEP) {
+		wrmsr(MSR_SYSENTER_CS, GD_KT);
+		wrmsr(MSR_SYSENTER_ESP, thiscpu->cpu_ts.ts_esp0);
+		wrmsr(MSR_SYSENTER_EIP, (uint32_t) sysenter_handler);
+	}
+
 	// Load the IDT
 	lidt(&idt_pd);
 }
@@ -271,10 +297,24 @@ trap_dispatch(struct Trapframe *tf)
 	// triggered on every CPU.
 	// LAB 6: Your code here.
 
+  // The LAPIC timer is one-shot, armed for the next kernel timer or
+  // the end of the time slice (see timer_program).  Only switch
+  // environments in the latter case.
   if(tf->tf_trapno == IRQ_OFFSET + IRQ_TIMER){
-    if(cpunum() == 0){
-      time_tick(); 
-    } 
+    thiscpu->cpu_timer_at = 0;
+    lapic_eoi();
+    timer_run();
+    if(curenv && curenv->env_status == ENV_RUNNING){
+      if(time_nsec() < thiscpu->cpu_quantum_end){
+        return;
+      }
+      sched_slice_expired(curenv);
+    }
+    sched_yield();
+  }
+
+  // Another CPU queued work for us while we were halted.
+  if(tf->tf_trapno == IRQ_OFFSET + IRQ_WAKEUP){
     lapic_eoi();
     sched_yield();
   }
@@ -290,6 +330,13 @@ trap_dispatch(struct Trapframe *tf)
     serial_intr();
     return;
   }
+
+  // The e1000 is on the slave 8259A, which needs an explicit EOI.
+  if(e1000_irq && tf->tf_trapno == IRQ_OFFSET + e1000_irq){
+    e1000_intr();
+    irq_eoi();
+    return;
+  }
   
   // Unexpected trap: The user process or the kernel has a bug.
 	print_trapframe(tf);
@@ -309,7 +356,6 @@ trap(struct Trapframe *tf)
 	asm volatile("cld" ::: "cc");
 
 	// Halt the CPU if some other CPU has called panic()
-	extern char *panicstr;
 	if (panicstr)
 		asm volatile("hlt");
 
@@ -324,11 +370,27 @@ trap(struct Trapframe *tf)
 
 	if ((tf->tf_cs & 3) == 3) {
 		// Trapped from user mode.
+		assert(curenv);
+
+		// System calls that only need the fine-grained locks run
+		// without the big kernel lock and return directly to the
+		// caller, so they proceed in parallel on every CPU.  A
+		// zombie takes the slow path below to get freed.
+		if (tf->tf_trapno == T_SYSCALL &&
+		    syscall_nolock(tf->tf_regs.reg_eax) &&
+		    curenv->env_status == ENV_RUNNING) {
+			struct PushRegs *regs = &tf->tf_regs;
+
+			regs->reg_eax = syscall(regs->reg_eax, regs->reg_edx,
+						regs->reg_ecx, regs->reg_ebx,
+						regs->reg_edi, regs->reg_esi);
+			env_pop_tf(tf);
+		}
+
 		// Acquire the big kernel lock before doing any
 		// serious kernel work.
 		// LAB 4: Your code here.
 		lock_kernel();
-    assert(curenv);
     
 		// Garbage collect if current enviroment is a zombie
 		if (curenv->env_status == ENV_DYING) {
@@ -0,0 +1,51 @@
+// Batches of system calls, run with a single sys_batch.
+
+#include <inc/lib.h>
+
+void
+batch_init(struct Batch *b)
+{
+	b->b_ncalls = 0;
+}
+
+// Queue a system call on batch 'b', first running the batch if it is
+// full.  Calls run in the order they were queued.
+// Returns 0 on success, or the error from running the full batch.
+int
+batch_add(struct Batch *b, uint32_t num, uint32_t a1, uint32_t a2,
+	  uint32_t a3, uint32_t a4, uint32_t a5)
+{
+	struct BatchCall *c;
+	int r;
+
+	if (b->b_ncalls == BATCH_NCALLS && (r = batch_flush(b)) < 0)
+		return r;
+	c = &b->b_calls[b->b_ncalls++];
+	c->bc_num = num;
+	c->bc_args[0] = a1;
+	c->bc_args[1] = a2;
+	c->bc_args[2] = a3;
+	c->bc_args[3] = a4;
+	c->bc_args[4] = a5;
+	return 0;
+}
+
+// Run the calls queued on batch 'b' and empty it.  The calls after
+// one that fails are not run.
+// Returns 0 if every call succeeded, or the error of the one that
+// failed.
+int
+batch_flush(struct Batch *b)
+{
+	int n, r;
+
+	if (b->b_ncalls == 0)
+		return 0;
+	n = b->b_ncalls;
+	b->b_ncalls = 0;
+	if ((r = sys_batch(b->b_calls, n)) < 0)
+		return r;
+	if (r > 0 && b->b_calls[r - 1].bc_ret < 0)
+		return b->b_calls[r - 1].bc_ret;
+	return 0;
+}
@@ -0,0 +1,93 @@
+// User-level shared-memory channel routines (see inc/chan.h).
+
+#include <inc/lib.h>
+
+// Create a channel whose ring is mapped at 'ring', carrying messages of
+// 'slotsize' bytes.  The ring is mapped PTE_SHARE, so children share
+// it; to share it with another environment, send it the page.
+// Returns 0 on success, < 0 on error.
+int
+chan_create(struct ChanRing *ring, size_t slotsize)
+{
+	uint32_t nslots;
+	int r;
+
+	if (slotsize == 0 || slotsize > sizeof(ring->cr_data))
+		return -E_INVAL;
+	if ((r = sys_chan_create(ring, PTE_P|PTE_U|PTE_W|PTE_SHARE)) < 0)
+		return r;
+
+	for (nslots = 1; nslots * 2 * slotsize <= sizeof(ring->cr_data); nslots *= 2)
+		;
+	ring->cr_nslots = nslots;
+	ring->cr_slotsize = slotsize;
+	return 0;
+}
+
+// Copy the message at 'msg' (cr_slotsize bytes) into the ring, sleeping
+// in the kernel while the ring is full.  The consumer is only notified
+// if the ring was empty, so a burst of messages costs at most one
+// system call.
+// Returns 1 if the consumer was notified, 0 if not, < 0 on error.
+int
+chan_send(struct ChanRing *ring, const void *msg)
+{
+	uint32_t tail = ring->cr_tail;
+	int r;
+
+	if (tail - ring->cr_head == ring->cr_nslots) {
+		// Say we are waiting before looking again, so that either
+		// we see the consumer's progress or it sees the flag and
+		// wakes us (see chan_recv).
+		ring->cr_waiting = 1;
+		__sync_synchronize();
+		while (tail - ring->cr_head == ring->cr_nslots)
+			if ((r = sys_chan_wait(ring, CHAN_WAIT_ROOM)) < 0) {
+				ring->cr_waiting = 0;
+				return r;
+			}
+		ring->cr_waiting = 0;
+	}
+	memmove(&ring->cr_data[(tail & (ring->cr_nslots - 1)) * ring->cr_slotsize],
+		msg, ring->cr_slotsize);
+
+	// Publish the slot, then look at the consumer's progress.  The
+	// fence keeps the load of cr_head from being satisfied before
+	// our store to cr_tail is visible; otherwise we could both see
+	// an empty ring and the consumer would sleep through our message.
+	__sync_synchronize();
+	ring->cr_tail = tail + 1;
+	__sync_synchronize();
+	if (ring->cr_head != tail)
+		return 0;
+	if ((r = sys_chan_notify(ring)) < 0)
+		return r;
+	return 1;
+}
+
+// Copy the next message out of the ring into 'msg' (cr_slotsize
+// bytes), sleeping in the kernel while the ring is empty.  The
+// producer is woken if it is waiting for room.
+// Returns 0 on success, < 0 on error.
+int
+chan_recv(struct ChanRing *ring, void *msg)
+{
+	uint32_t head = ring->cr_head;
+	int r;
+
+	while (ring->cr_tail == head)
+		if ((r = sys_chan_wait(ring, CHAN_WAIT_DATA)) < 0)
+			return r;
+	memmove(msg, &ring->cr_data[(head & (ring->cr_nslots - 1)) * ring->cr_slotsize],
+		ring->cr_slotsize);
+
+	// Finish reading the slot before handing it back to the producer,
+	// then look at whether it is waiting; as in chan_send, the fence
+	// keeps the load from being satisfied before the store.
+	__sync_synchronize();
+	ring->cr_head = head + 1;
+	__sync_synchronize();
+	if (ring->cr_waiting && (r = sys_chan_notify(ring)) < 0)
+		return r;
+	return 0;
+}
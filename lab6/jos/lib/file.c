@@ -24,8 +24,30 @@ fsipc(unsigned type, void *dstva)
 	if (debug)
 		cprintf("[%08x] fsipc %d %08x\n", thisenv->env_id, type, *(uint32_t *)&fsipcbuf);
 
-	ipc_send(fsenv, type, &fsipcbuf, PTE_P | PTE_W | PTE_U);
-	return ipc_recv(NULL, dstva, NULL);
+	return ipc_call(fsenv, type, &fsipcbuf, PTE_P | PTE_W | PTE_U,
+			dstva, NULL);
+}
+
+// Where devfile_read receives the file server's pages.
+#define FSREADVA	((char *) 0xCFFF0000)
+
+// Like fsipc, but receives up to IPC_MAXPAGES pages of the reply at
+// FSREADVA.
+static int
+fsipc_read(void)
+{
+	static envid_t fsenv;
+	struct IpcVec v;
+
+	if (fsenv == 0)
+		fsenv = ipc_find_env(ENV_TYPE_FS);
+
+	v.iv_npages = 1;
+	v.iv_pages[0].ip_va = &fsipcbuf;
+	v.iv_pages[0].ip_perm = PTE_P | PTE_W | PTE_U;
+	v.iv_dstva = FSREADVA;
+	v.iv_dstnpages = IPC_MAXPAGES;
+	return ipc_callv(fsenv, FSREQ_READ, &v, NULL);
 }
 
 static int devfile_flush(struct Fd *fd);
@@ -112,18 +134,19 @@ static ssize_t
 devfile_read(struct Fd *fd, void *buf, size_t n)
 {
 	// Make an FSREQ_READ request to the file system server after
-	// filling fsipcbuf.read with the request arguments.  The
-	// bytes read will be written back to fsipcbuf by the file
-	// system server.
+	// filling fsipcbuf.read with the request arguments.  The file
+	// system server maps the pages holding the bytes read at
+	// FSREADVA, and says where they start in fsipcbuf.readRet, so
+	// one round trip can read up to IPC_MAXPAGES pages.
 	int r;
 
 	fsipcbuf.read.req_fileid = fd->fd_file.id;
 	fsipcbuf.read.req_n = n;
-	if ((r = fsipc(FSREQ_READ, NULL)) < 0)
+	if ((r = fsipc_read()) < 0)
 		return r;
 	assert(r <= n);
-	assert(r <= PGSIZE);
-	memmove(buf, fsipcbuf.readRet.ret_buf, r);
+	assert(fsipcbuf.readRet.ret_off + r <= IPC_MAXPAGES * PGSIZE);
+	memmove(buf, FSREADVA + fsipcbuf.readRet.ret_off, r);
 	return r;
 }
 
@@ -66,11 +66,14 @@ pgfault(struct UTrapframe *utf)
 // copy-on-write again if it was already copy-on-write at the beginning of
 // this function?)
 //
+// If 'b' is not NULL, the mappings are queued on batch 'b' rather than
+// made right away.
+//
 // Returns: 0 on success, < 0 on error.
 // It is also OK to panic on error.
 //
 static int
-duppage(envid_t envid, unsigned pn)
+duppage(struct Batch *b, envid_t envid, unsigned pn)
 {
 	int r;
  
@@ -82,7 +85,11 @@ duppage(envid_t envid, unsigned pn)
   perm = PTE_P|PTE_U;
   
   if(uvpt[pn] & PTE_SHARE){
-    if((r = sys_page_map(0, addr, envid, addr, PTE_SYSCALL)) < 0){
+    if(b){
+      return batch_add(b, SYS_page_map, 0, (uint32_t)addr, envid,
+                       (uint32_t)addr, uvpt[pn] & PTE_SYSCALL);
+    }
+    if((r = sys_page_map(0, addr, envid, addr, uvpt[pn] & PTE_SYSCALL)) < 0){
       return r;
     }
     return 0;
@@ -91,6 +98,16 @@ duppage(envid_t envid, unsigned pn)
   if((uvpt[pn] & PTE_W) || (uvpt[pn] & PTE_COW)){ 
     perm |= PTE_COW;
   }
+
+  if(b){
+    if((r = batch_add(b, SYS_page_map, 0, (uint32_t)addr, envid, (uint32_t)addr, perm)) < 0){
+      return r;
+    }
+    if(perm & PTE_COW){
+      return batch_add(b, SYS_page_map, 0, (uint32_t)addr, 0, (uint32_t)addr, perm);
+    }
+    return 0;
+  }
      
   // map into the child address space
   if((r = sys_page_map(0, addr, envid, addr, perm)) < 0){
@@ -124,6 +141,12 @@ duppage(envid_t envid, unsigned pn)
 //   Neither user exception stack should ever be marked copy-on-write,
 //   so you must allocate a new page for the child's user exception stack.
 //
+// The batch fork fills in with the mappings for the child.  The kernel
+// writes the results back into it after running the batch, and can't
+// if the batch has made its page copy-on-write, so fork duplicates that
+// page separately, after the rest of the address space.
+static struct Batch forkbatch __attribute__((aligned(PGSIZE)));
+
 envid_t
 fork(void)
 {
@@ -131,6 +154,7 @@ fork(void)
   envid_t envid;
   int re;
   uint8_t *addr;
+  struct Batch *b = &forkbatch;
   extern void _pgfault_upcall(void);
    
   set_pgfault_handler(pgfault); //  set the page fault handler for parent
@@ -148,32 +172,39 @@ fork(void)
   
 
   // the parent
-  // copy the address space below UTOP
+  // copy the address space below UTOP, a batch of pages per trap
+  batch_init(b);
   for(addr = (uint8_t *)UTEXT; addr < (uint8_t *)(UXSTACKTOP - PGSIZE); addr += PGSIZE){
+    if(PGNUM(addr) == PGNUM(b)){
+      continue;
+    }
     if((uvpd[PDX(addr)]&PTE_P) && (uvpt[PGNUM(addr)]&PTE_P)){
-      duppage(envid, PGNUM(addr));
+      if((re = duppage(b, envid, PGNUM(addr))) < 0){
+        panic("duppage: %e \n", re);
+      }
     }
   }
+  if((re = batch_flush(b)) < 0){
+    panic("duppage: %e \n", re);
+  }
+  if((re = duppage(NULL, envid, PGNUM(b))) < 0){
+    panic("duppage: %e \n", re);
+  }
   
   // UXSTACKTOP need alloc
-  if((re = sys_page_alloc(envid, (void *)(UXSTACKTOP - PGSIZE), PTE_P|PTE_U|PTE_W)) < 0){
-    panic("sys_page_alloc: %e \n", re);
-  }
-  if((re = sys_page_map(envid, (void *)(UXSTACKTOP - PGSIZE), 0, UTEMP, PTE_P|PTE_U|PTE_W)) < 0){
-    panic("sys_page_map: %e \n", re);
+  if((re = batch_add(b, SYS_page_alloc, envid, UXSTACKTOP - PGSIZE, PTE_P|PTE_U|PTE_W, 0, 0)) < 0 ||
+     (re = batch_add(b, SYS_page_map, envid, UXSTACKTOP - PGSIZE, 0, (uint32_t)UTEMP, PTE_P|PTE_U|PTE_W)) < 0 ||
+     (re = batch_flush(b)) < 0){
+    panic("exception stack: %e \n", re);
   }
   memmove(UTEMP, (void *)(UXSTACKTOP -PGSIZE), PGSIZE);
-  if((re = sys_page_unmap(0, UTEMP)) < 0){
-    panic("sys_page_unmap: %e \n", re); 
-  }
-  
 
-  // set child's page fault handler
-  sys_env_set_pgfault_upcall(envid, _pgfault_upcall);
-   
-  // set child environment  
-  if((re = sys_env_set_status(envid, ENV_RUNNABLE))){
-    panic("sys_env_set_status: %e", re);
+  // set child's page fault handler, and set child environment running
+  if((re = batch_add(b, SYS_page_unmap, 0, (uint32_t)UTEMP, 0, 0, 0)) < 0 ||
+     (re = batch_add(b, SYS_env_set_pgfault_upcall, envid, (uint32_t)_pgfault_upcall, 0, 0, 0)) < 0 ||
+     (re = batch_add(b, SYS_env_set_status, envid, ENV_RUNNABLE, 0, 0, 0)) < 0 ||
+     (re = batch_flush(b)) < 0){
+    panic("fork: %e", re);
   }
   return envid;
   // panic("fork not implemented");
@@ -52,13 +52,38 @@ ipc_recv(envid_t *from_env_store, void *pg, int *perm_store)
 	// return 0;
 }
 
+// Like ipc_recv, but give up if no message arrives within 'msec'
+// milliseconds, returning -E_TIMEOUT.  With 'msec' 0, only take a
+// message whose sender is already blocked sending to us.
+int32_t
+ipc_recv_timeout(envid_t *from_env_store, void *pg, int *perm_store,
+		 uint32_t msec)
+{
+	int r;
+
+	if (pg == NULL)
+		pg = (void *) UTOP;
+	if ((r = sys_ipc_recv_timeout(pg, msec)) < 0) {
+		if (from_env_store)
+			*from_env_store = 0;
+		if (perm_store)
+			*perm_store = 0;
+		return r;
+	}
+	if (from_env_store)
+		*from_env_store = thisenv->env_ipc_from;
+	if (perm_store)
+		*perm_store = thisenv->env_ipc_perm;
+	return thisenv->env_ipc_value;
+}
+
 // Send 'val' (and 'pg' with 'perm', if 'pg' is nonnull) to 'toenv'.
-// This function keeps trying until it succeeds.
-// It should panic() on any error other than -E_IPC_NOT_RECV.
+// This function blocks in the kernel until 'toenv' receives the
+// message; senders to the same environment are served in FIFO order.
+// It should panic() on any error.
 //
 // Hint:
-//   Use sys_yield() to be CPU-friendly.
-//   If 'pg' is null, pass sys_ipc_try_send a value that it will understand
+//   If 'pg' is null, pass sys_ipc_send a value that it will understand
 //   as meaning "no page".  (Zero is not the right value.)
 void
 ipc_send(envid_t to_env, uint32_t val, void *pg, int perm)
@@ -69,18 +94,107 @@ ipc_send(envid_t to_env, uint32_t val, void *pg, int perm)
   if(pg == NULL){
     pg = (void *)UTOP;
   } 
-  while(1){
-    re = sys_ipc_try_send(to_env, val, pg, perm);
-    if(re == -E_IPC_NOT_RECV){
-      sys_yield();
-    }else if(re == 0){
-      break;
-    }else{
-      panic("ipc_send: %e", re);
-    }
+  if((re = sys_ipc_send(to_env, val, pg, perm)) < 0){
+    panic("ipc_send: %e", re);
   }
-   
-	// panic("ipc_send not implemented");
+}
+
+// Send 'val' (and 'pg' with 'perm', if 'pg' is nonnull) to 'to_env' and
+// wait for its reply, like ipc_send followed by ipc_recv, but in one
+// system call that switches straight to 'to_env' if it is waiting.
+// Only a message from 'to_env' counts as the reply.  'rcv_pg' and
+// 'perm_store' are as for ipc_recv's 'pg' and 'perm_store'.
+// Returns the value of the reply.  It should panic() on any error.
+int32_t
+ipc_call(envid_t to_env, uint32_t val, void *pg, int perm,
+	 void *rcv_pg, int *perm_store)
+{
+	int r;
+
+	if (pg == NULL)
+		pg = (void *) UTOP;
+	if (rcv_pg == NULL)
+		rcv_pg = (void *) UTOP;
+	if ((r = sys_ipc_call(to_env, val, pg, perm, rcv_pg)) < 0)
+		panic("ipc_call: %e", r);
+	if (perm_store)
+		*perm_store = thisenv->env_ipc_perm;
+	return thisenv->env_ipc_value;
+}
+
+// The server side of ipc_call: reply to 'to_env' with 'val' (and 'pg'
+// with 'perm', if 'pg' is nonnull), then receive the next request and
+// return it as ipc_recv does.  If 'to_env' is not waiting for a reply,
+// the reply is tried once more with sys_ipc_try_send, which never
+// blocks.  A reply that cannot be delivered because 'to_env' is gone
+// is dropped; one that cannot be delivered for any other reason (say,
+// 'to_env' is not receiving, or a bad 'pg') is dropped with a warning.
+// Either way the server carries on: a client that misbehaves must not
+// be able to take it down.
+int32_t
+ipc_reply_wait(envid_t to_env, uint32_t val, void *pg, int perm,
+	       envid_t *from_env_store, void *rcv_pg, int *perm_store)
+{
+	int r;
+
+	if (pg == NULL)
+		pg = (void *) UTOP;
+	if ((r = sys_ipc_reply_wait(to_env, val, pg, perm,
+				    rcv_pg ? rcv_pg : (void *) UTOP)) < 0) {
+		if (r == -E_IPC_NOT_RECV)
+			r = sys_ipc_try_send(to_env, val, pg, perm);
+		if (r < 0 && r != -E_BAD_ENV)
+			cprintf("ipc_reply_wait: reply to %08x dropped: %e\n",
+				to_env, r);
+		return ipc_recv(from_env_store, rcv_pg, perm_store);
+	}
+	if (from_env_store)
+		*from_env_store = thisenv->env_ipc_from;
+	if (perm_store)
+		*perm_store = thisenv->env_ipc_perm;
+	return thisenv->env_ipc_value;
+}
+
+// Like ipc_call, but sends the pages listed in 'vec' and receives up
+// to vec->iv_dstnpages pages of the reply at vec->iv_dstva.  As with
+// ipc_call, 'perm_store' gets the permission of the first page
+// received; thisenv->env_ipc_npages holds the number of pages.
+// Returns the value of the reply.  It should panic() on any error.
+int32_t
+ipc_callv(envid_t to_env, uint32_t val, const struct IpcVec *vec,
+	  int *perm_store)
+{
+	int r;
+
+	if ((r = sys_ipc_callv(to_env, val, vec)) < 0)
+		panic("ipc_callv: %e", r);
+	if (perm_store)
+		*perm_store = thisenv->env_ipc_perm;
+	return thisenv->env_ipc_value;
+}
+
+// Like ipc_reply_wait, but replies with the pages listed in 'vec' and
+// receives the next request into vec's receive window.  Undeliverable
+// replies are dropped as by ipc_reply_wait; since there is no
+// non-blocking sys_ipc_sendv, a reply to an env that is not waiting
+// for it is dropped with a warning straight away.
+int32_t
+ipc_reply_waitv(envid_t to_env, uint32_t val, const struct IpcVec *vec,
+		envid_t *from_env_store, int *perm_store)
+{
+	int r;
+
+	if ((r = sys_ipc_reply_waitv(to_env, val, vec)) < 0) {
+		if (r != -E_BAD_ENV)
+			cprintf("ipc_reply_waitv: reply to %08x dropped: %e\n",
+				to_env, r);
+		r = sys_ipc_recvv(vec);
+	}
+	if (from_env_store)
+		*from_env_store = r < 0 ? 0 : thisenv->env_ipc_from;
+	if (perm_store)
+		*perm_store = r < 0 ? 0 : thisenv->env_ipc_perm;
+	return r < 0 ? r : thisenv->env_ipc_value;
 }
 
 // Find the first environment of the given type.  We'll use this to
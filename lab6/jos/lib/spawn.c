@@ -260,12 +260,15 @@ error:
 	return r;
 }
 
+// Pages of a segment read from the file at a time, through UTEMP
+#define SEGCHUNK	16
+
 static int
 map_segment(envid_t child, uintptr_t va, size_t memsz,
 	int fd, size_t filesz, off_t fileoffset, int perm)
 {
-	int i, r;
-	void *blk;
+	int i, j, n, r;
+	struct Batch b;
 
 	//cprintf("map_segment %x+%x\n", va, memsz);
 
@@ -276,25 +279,42 @@ map_segment(envid_t child, uintptr_t va, size_t memsz,
 		fileoffset -= i;
 	}
 
-	for (i = 0; i < memsz; i += PGSIZE) {
+	// The page allocations and mappings go to the kernel in batches,
+	// and file pages are read SEGCHUNK at a time.
+	batch_init(&b);
+	for (i = 0; i < memsz; i += n * PGSIZE) {
 		if (i >= filesz) {
 			// allocate a blank page
-			if ((r = sys_page_alloc(child, (void*) (va + i), perm)) < 0)
+			n = 1;
+			if ((r = batch_add(&b, SYS_page_alloc, child, va + i, perm, 0, 0)) < 0)
 				return r;
 		} else {
 			// from file
-			if ((r = sys_page_alloc(0, UTEMP, PTE_P|PTE_U|PTE_W)) < 0)
+			n = MIN(SEGCHUNK, ROUNDUP(filesz - i, PGSIZE) / PGSIZE);
+			for (j = 0; j < n; j++)
+				if ((r = batch_add(&b, SYS_page_alloc, 0,
+						   (uint32_t) UTEMP + j * PGSIZE,
+						   PTE_P|PTE_U|PTE_W, 0, 0)) < 0)
+					return r;
+			if ((r = batch_flush(&b)) < 0)
 				return r;
 			if ((r = seek(fd, fileoffset + i)) < 0)
 				return r;
-			if ((r = readn(fd, UTEMP, MIN(PGSIZE, filesz-i))) < 0)
+			if ((r = readn(fd, UTEMP, MIN(n * PGSIZE, filesz-i))) < 0)
 				return r;
-			if ((r = sys_page_map(0, UTEMP, child, (void*) (va + i), perm)) < 0)
-				panic("spawn: sys_page_map data: %e", r);
-			sys_page_unmap(0, UTEMP);
+			for (j = 0; j < n; j++) {
+				if ((r = batch_add(&b, SYS_page_map, 0,
+						   (uint32_t) UTEMP + j * PGSIZE,
+						   child, va + i + j * PGSIZE, perm)) < 0)
+					return r;
+				if ((r = batch_add(&b, SYS_page_unmap, 0,
+						   (uint32_t) UTEMP + j * PGSIZE,
+						   0, 0, 0)) < 0)
+					return r;
+			}
 		}
 	}
-	return 0;
+	return batch_flush(&b);
 }
 
 // Copy the mappings for shared pages into the child address space.
@@ -303,13 +323,19 @@ copy_shared_pages(envid_t child)
 {
 	// LAB 5: Your code here.
   uint8_t *addr;
+  struct Batch b;
+  int r;
   
+  batch_init(&b);
   for(addr = (uint8_t *)UTEXT; addr < (uint8_t *)(UXSTACKTOP - PGSIZE); addr += PGSIZE){
     if((uvpd[PDX(addr)] & PTE_P) && (uvpt[PGNUM(addr)] & PTE_P) && (uvpt[PGNUM(addr)] & PTE_SHARE)){
-     sys_page_map(0, addr, child, addr, PTE_SHARE|PTE_U|PTE_P|PTE_W);
+      if((r = batch_add(&b, SYS_page_map, 0, (uint32_t)addr, child, (uint32_t)addr,
+                        uvpt[PGNUM(addr)] & PTE_SYSCALL)) < 0){
+        return r;
+      }
     }
   }
-	return 0;
+	return batch_flush(&b);
 }
 
 
@@ -2,6 +2,7 @@
 
 #include <inc/syscall.h>
 #include <inc/lib.h>
+#include <inc/x86.h>
 
 static inline int32_t
 syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4, uint32_t a5)
@@ -37,6 +38,45 @@ syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3, uint32_t a4,
 	return ret;
 }
 
+// Fast system call through sysenter, for the calls the kernel serves
+// without building a trapframe (see sysenter_handler in
+// kern/trapentry.S).  Pass the system call number in AX and up to
+// three parameters in DX, CX and BX.  The kernel returns with sysexit
+// to the address we leave in SI, on the stack pointer we leave in BP;
+// DX and CX are clobbered.
+//
+// CPUs without SEP (CPUID.01H:EDX bit 11) have no sysenter; there the
+// call goes through syscall() instead.
+static inline int32_t
+fast_syscall(int num, int check, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+	static int has_sep = -1;	// unknown until the first call
+	uint32_t edx;
+	int32_t ret;
+
+	if (has_sep < 0) {
+		cpuid(1, NULL, NULL, NULL, &edx);
+		has_sep = (edx & CPUID_SEP) != 0;
+	}
+	if (!has_sep)
+		return syscall(num, check, a1, a2, a3, 0, 0);
+
+	asm volatile("pushl %%ebp\n\t"
+		     "movl %%esp, %%ebp\n\t"
+		     "leal 1f, %%esi\n\t"
+		     "sysenter\n"
+		     "1:\tpopl %%ebp\n"
+		     : "=a" (ret), "+d" (a1), "+c" (a2)
+		     : "0" (num),
+		       "b" (a3)
+		     : "esi", "cc", "memory");
+
+	if(check && ret > 0)
+		panic("syscall %d returned %d (> 0)", num, ret);
+
+	return ret;
+}
+
 void
 sys_cputs(const char *s, size_t len)
 {
@@ -58,7 +98,7 @@ sys_env_destroy(envid_t envid)
 envid_t
 sys_getenvid(void)
 {
-	 return syscall(SYS_getenvid, 0, 0, 0, 0, 0, 0);
+	 return fast_syscall(SYS_getenvid, 0, 0, 0, 0);
 }
 
 void
@@ -70,7 +110,7 @@ sys_yield(void)
 int
 sys_page_alloc(envid_t envid, void *va, int perm)
 {
-	return syscall(SYS_page_alloc, 1, envid, (uint32_t) va, perm, 0, 0);
+	return fast_syscall(SYS_page_alloc, 1, envid, (uint32_t) va, perm);
 }
 
 int
@@ -105,22 +145,112 @@ sys_env_set_pgfault_upcall(envid_t envid, void *upcall)
 	return syscall(SYS_env_set_pgfault_upcall, 1, envid, (uint32_t) upcall, 0, 0, 0);
 }
 
+int
+sys_env_set_priority(envid_t envid, int prio)
+{
+	return syscall(SYS_env_set_priority, 1, envid, prio, 0, 0, 0);
+}
+
+int
+sys_sched_set_policy(int policy)
+{
+	return syscall(SYS_sched_set_policy, 1, policy, 0, 0, 0, 0);
+}
+
 int
 sys_ipc_try_send(envid_t envid, uint32_t value, void *srcva, int perm)
 {
 	return syscall(SYS_ipc_try_send, 0, envid, value, (uint32_t) srcva, perm, 0);
 }
 
+int
+sys_ipc_send(envid_t envid, uint32_t value, void *srcva, int perm)
+{
+	return syscall(SYS_ipc_send, 0, envid, value, (uint32_t) srcva, perm, 0);
+}
+
+int
+sys_ipc_call(envid_t envid, uint32_t value, void *srcva, int perm, void *dstva)
+{
+	return syscall(SYS_ipc_call, 0, envid, value, (uint32_t) srcva, perm, (uint32_t) dstva);
+}
+
+int
+sys_ipc_reply_wait(envid_t envid, uint32_t value, void *srcva, int perm, void *dstva)
+{
+	return syscall(SYS_ipc_reply_wait, 0, envid, value, (uint32_t) srcva, perm, (uint32_t) dstva);
+}
+
 int
 sys_ipc_recv(void *dstva)
 {
 	return syscall(SYS_ipc_recv, 1, (uint32_t)dstva, 0, 0, 0, 0);
 }
 
+int
+sys_ipc_sendv(envid_t envid, uint32_t value, const struct IpcVec *vec)
+{
+	return syscall(SYS_ipc_sendv, 0, envid, value, (uint32_t) vec, 0, 0);
+}
+
+int
+sys_ipc_recvv(const struct IpcVec *vec)
+{
+	return syscall(SYS_ipc_recvv, 1, (uint32_t) vec, 0, 0, 0, 0);
+}
+
+int
+sys_ipc_callv(envid_t envid, uint32_t value, const struct IpcVec *vec)
+{
+	return syscall(SYS_ipc_callv, 0, envid, value, (uint32_t) vec, 0, 0);
+}
+
+int
+sys_ipc_reply_waitv(envid_t envid, uint32_t value, const struct IpcVec *vec)
+{
+	return syscall(SYS_ipc_reply_waitv, 0, envid, value, (uint32_t) vec, 0, 0);
+}
+
+int
+sys_chan_create(void *va, int perm)
+{
+	return syscall(SYS_chan_create, 1, (uint32_t) va, perm, 0, 0, 0);
+}
+
+int
+sys_chan_wait(void *va, int what)
+{
+	return syscall(SYS_chan_wait, 1, (uint32_t) va, what, 0, 0, 0);
+}
+
+int
+sys_chan_notify(void *va)
+{
+	return syscall(SYS_chan_notify, 1, (uint32_t) va, 0, 0, 0, 0);
+}
+
+int
+sys_batch(struct BatchCall *calls, int n)
+{
+	return syscall(SYS_batch, 0, (uint32_t) calls, n, 0, 0, 0);
+}
+
+int
+sys_sleep(uint32_t msec)
+{
+	return syscall(SYS_sleep, 0, msec, 0, 0, 0, 0);
+}
+
+int
+sys_ipc_recv_timeout(void *dstva, uint32_t msec)
+{
+	return syscall(SYS_ipc_recv_timeout, 0, (uint32_t) dstva, msec, 0, 0, 0);
+}
+
 unsigned int
 sys_time_msec(void)
 {
-	return (unsigned int) syscall(SYS_time_msec, 0, 0, 0, 0, 0, 0);
+	return (unsigned int) fast_syscall(SYS_time_msec, 0, 0, 0, 0);
 }
 
 int
@@ -133,3 +263,33 @@ int
 sys_receive_packet(char *data_store, int *len_store){
   return syscall(SYS_receive_packet, 1, (uint32_t)data_store, (uint32_t)len_store, 0, 0, 0);
 }
+
+int
+sys_transmit_sg(const struct TxSeg *segs, int nsegs)
+{
+	return syscall(SYS_transmit_sg, 0, (uint32_t) segs, nsegs, 0, 0, 0);
+}
+
+int
+sys_transmit_packets(const struct TxSeg *pkts, int npkts)
+{
+	return syscall(SYS_transmit_packets, 0, (uint32_t) pkts, npkts, 0, 0, 0);
+}
+
+int
+sys_receive_pages(void *va, int npages)
+{
+	return syscall(SYS_receive_pages, 0, (uint32_t) va, npages, 0, 0, 0);
+}
+
+int
+sys_receive_page(void *va)
+{
+	return syscall(SYS_receive_page, 0, (uint32_t) va, 0, 0, 0, 0);
+}
+
+int
+sys_receive_wait(void)
+{
+	return syscall(SYS_receive_wait, 0, 0, 0, 0, 0, 0);
+}
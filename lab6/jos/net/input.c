@@ -1,23 +1,11 @@
 #include "ns.h"
 #include "kern/e1000.h"
 
-extern union Nsipc nsipcbuf;
+// pages the kernel maps received packets at, a batch at a time
+static union Nsipc rxbufs[NET_MAXBATCH] __attribute__((aligned(PGSIZE)));
 
 void sleep(int msec){
-  unsigned now = sys_time_msec(); 
-  unsigned end = now + msec;
-
-  if((int)now < 0 && (int)now > -MAXERROR){
-    panic("sys_time_msec: %e", (int)now);  
-  }
-
-  if(end < now){
-    panic("sleep: wrap");
-  }
-
-  while(sys_time_msec() < end){
-    sys_yield();
-  }
+  sys_sleep(msec);
 } 
 
 void
@@ -31,18 +19,26 @@ input(envid_t ns_envid)
 	// Hint: When you IPC a page to the network server, it will be
 	// reading from it for a while, so don't immediately receive
 	// another packet in to the same physical page.
-  int len ;
-  char buf[E1000_RXPKTSIZE];
+  int re, i;
    
   while(1){
-    while((sys_receive_packet(buf, &len)) < 0){
-      sys_yield();
+    // Have the kernel map the pages the card received the waiting
+    // packets into at rxbufs, each already laid out as a struct
+    // jif_pkt.  This also replaces the pages we sent the network
+    // server last time, which it may still be reading.  Block in the
+    // kernel until a packet arrives, or poll if the card's interrupts
+    // aren't available.
+    while((re = sys_receive_pages(rxbufs, NET_MAXBATCH)) < 0){
+      if(re == -E_NO_MEM){
+        panic("input: sys_receive_pages: %e", re);
+      }
+      if(sys_receive_wait() < 0){
+        sys_yield();
+      }
     } 
     
-    nsipcbuf.pkt.jp_len = len;
-    memcpy(nsipcbuf.pkt.jp_data, buf, len);
-    
-    ipc_send(ns_envid, NSREQ_INPUT, &nsipcbuf, PTE_U | PTE_P | PTE_W);
-    sleep(50); 
+    for(i = 0; i < re; i++){
+      ipc_send(ns_envid, NSREQ_INPUT, &rxbufs[i], PTE_U | PTE_P | PTE_W);
+    }
   }
 }
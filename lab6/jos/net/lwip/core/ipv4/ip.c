@@ -521,8 +521,10 @@ ip_output_if(struct pbuf *p, struct ip_addr *src, struct ip_addr *dest,
   }
 
 #if IP_FRAG
-  /* don't fragment if interface has mtu set to 0 [loopif] */
-  if (netif->mtu && (p->tot_len > netif->mtu))
+  /* don't fragment if interface has mtu set to 0 [loopif], nor TCP
+   * segments that the netif splits itself [TCP_TSO_SEG] */
+  if (netif->mtu && (p->tot_len > netif->mtu) &&
+      !(TCP_TSO_SEG && IPH_PROTO(iphdr) == IP_PROTO_TCP))
     return ip_frag(p,netif,dest);
 #endif
 
@@ -111,6 +111,14 @@ tcp_write(struct tcp_pcb *pcb, const void *data, u16_t len, u8_t apiflags)
   }
 }
 
+/* The longest segment to build: with TCP segmentation offload, the
+ * netif splits longer ones at TCP_MSS. */
+#if TCP_TSO_SEG
+#define TCP_SEGLEN(pcb) ((pcb)->mss == TCP_MSS ? TCP_TSO_SEG : (pcb)->mss)
+#else
+#define TCP_SEGLEN(pcb) ((pcb)->mss)
+#endif
+
 /**
  * Enqueue either data or TCP options (but not both) for tranmission
  *
@@ -185,7 +193,7 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
 
     /* The segment length should be the MSS if the data to be enqueued
      * is larger than the MSS. */
-    seglen = left > pcb->mss? pcb->mss: left;
+    seglen = left > TCP_SEGLEN(pcb)? TCP_SEGLEN(pcb): left;
 
     /* Allocate memory for tcp_seg, and fill in fields. */
     seg = memp_malloc(MEMP_TCP_SEG);
@@ -331,7 +339,7 @@ tcp_enqueue(struct tcp_pcb *pcb, void *arg, u16_t len,
     !(TCPH_FLAGS(useg->tcphdr) & (TCP_SYN | TCP_FIN)) &&
     !(flags & (TCP_SYN | TCP_FIN)) &&
     /* fit within max seg size */
-    useg->len + queue->len <= pcb->mss) {
+    useg->len + queue->len <= TCP_SEGLEN(pcb)) {
     /* Remove TCP header from first segment of our to-be-queued list */
     if(pbuf_header(queue->p, -TCP_HLEN)) {
       /* Can we cope with this failing?  Just assert for now */
@@ -697,6 +697,15 @@
 #define TCP_MSS                         128
 #endif
 
+/**
+ * TCP_TSO_SEG: if nonzero, the longest segment to build for sending,
+ * which the netif splits into TCP_MSS-sized ones itself (TCP
+ * segmentation offload).  Only used while the send MSS is TCP_MSS.
+ */
+#ifndef TCP_TSO_SEG
+#define TCP_TSO_SEG                     0
+#endif
+
 /**
  * TCP_CALCULATE_EFF_SEND_MSS: "The maximum size of a segment that TCP really
  * sends, the 'effective send MSS,' MUST be the smaller of the send MSS (which
@@ -33,7 +33,7 @@ thread_wakeup(volatile uint32_t *addr) {
 
 void
 thread_wait(volatile uint32_t *addr, uint32_t val, uint32_t msec) {
-    uint32_t s = sys_time_msec();
+    uint32_t s = time_msec();
     uint32_t p = s;
 
     cur_tc->tc_wait_addr = addr;
@@ -47,8 +47,13 @@ thread_wait(volatile uint32_t *addr, uint32_t val, uint32_t msec) {
 	if (cur_tc->tc_wakeup)
 	    break;
 
-	thread_yield();
-	p = sys_time_msec();
+	// with no other thread to run, nothing can wake us before the
+	// deadline, so sleep in the kernel rather than spin
+	if (thread_queue.tq_first)
+	    thread_yield();
+	else
+	    sys_sleep(msec - p);
+	p = time_msec();
     }
 
     cur_tc->tc_wait_addr = 0;
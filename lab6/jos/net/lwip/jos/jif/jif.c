@@ -41,6 +41,9 @@
 #include "lwip/pbuf.h"
 #include "lwip/sys.h"
 #include <lwip/stats.h>
+#include <lwip/ip.h>
+#include <lwip/tcp.h>
+#include <lwip/inet_chksum.h>
 
 #include <netif/etharp.h>
 
@@ -69,6 +72,123 @@ low_level_init(struct netif *netif)
     netif->hwaddr[5] = 0x56;
 }
 
+/*
+ * jif_pseudo_sum():
+ *
+ * Sum (without complementing) the pseudo-header of a 'len'-byte
+ * segment of protocol 'proto' in the IPv4 packet iphdr.
+ *
+ */
+static u16_t
+jif_pseudo_sum(struct ip_hdr *iphdr, u8_t proto, u16_t len)
+{
+    u16_t *src = (u16_t *)&iphdr->src;
+    u16_t *dest = (u16_t *)&iphdr->dest;
+    u32_t acc;
+
+    acc = src[0] + src[1] + dest[0] + dest[1];
+    acc += htons(proto) + htons(len);
+    while (acc >> 16)
+	acc = (acc & 0xffff) + (acc >> 16);
+    return acc;
+}
+
+/*
+ * jif_tx_csum():
+ *
+ * lwIP leaves the IP and TCP checksums of outgoing packets to the
+ * e1000 (see CHECKSUM_GEN_* in lwipopts.h).  Ask for them in
+ * pkt->jp_csum: the card sums the IP header, and for TCP the segment
+ * from its header on, so the TCP checksum field is seeded with the sum
+ * of the pseudo-header.  IP fragments of TCP would need the whole
+ * segment, which lwIP doesn't send.
+ *
+ * TCP segments longer than TCP_MSS, which lwIP builds up to
+ * TCP_TSO_SEG, are split by the card too, so the pseudo-header sum
+ * leaves out the length, which differs from one piece to the next.
+ *
+ */
+static void
+jif_tx_csum(struct jif_pkt *pkt)
+{
+    struct eth_hdr *ethhdr = (struct eth_hdr *)pkt->jp_data;
+    struct ip_hdr *iphdr = (struct ip_hdr *)(ethhdr + 1);
+    struct tcp_hdr *tcphdr;
+    int hlen, thlen, len;
+
+    memset(&pkt->jp_csum, 0, sizeof(pkt->jp_csum));
+    if (pkt->jp_len < sizeof(*ethhdr) + IP_HLEN ||
+	htons(ethhdr->type) != ETHTYPE_IP)
+	return;
+    hlen = IPH_HL(iphdr) * 4;
+    if (hlen < IP_HLEN || sizeof(*ethhdr) + hlen > pkt->jp_len)
+	return;
+
+    IPH_CHKSUM_SET(iphdr, 0);
+    pkt->jp_csum.pc_flags = PKTCSUM_IP;
+    pkt->jp_csum.pc_ipcss = sizeof(*ethhdr);
+    pkt->jp_csum.pc_tucss = sizeof(*ethhdr) + hlen;
+
+    if (IPH_PROTO(iphdr) != IP_PROTO_TCP ||
+	(IPH_OFFSET(iphdr) & htons(IP_MF | IP_OFFMASK)) ||
+	sizeof(*ethhdr) + hlen + TCP_HLEN > pkt->jp_len)
+	return;
+    tcphdr = (struct tcp_hdr *)((char *)iphdr + hlen);
+    thlen = TCPH_HDRLEN(tcphdr) * 4;
+    len = ntohs(IPH_LEN(iphdr)) - hlen;
+    pkt->jp_csum.pc_flags |= PKTCSUM_L4;
+    pkt->jp_csum.pc_tucso = pkt->jp_csum.pc_tucss +
+			    offsetof(struct tcp_hdr, chksum);
+
+    if (len - thlen > TCP_MSS) {
+	tcphdr->chksum = jif_pseudo_sum(iphdr, IP_PROTO_TCP, 0);
+	pkt->jp_csum.pc_flags |= PKTCSUM_TSO;
+	pkt->jp_csum.pc_hdrlen = pkt->jp_csum.pc_tucss + thlen;
+	pkt->jp_csum.pc_mss = TCP_MSS;
+    } else
+	tcphdr->chksum = jif_pseudo_sum(iphdr, IP_PROTO_TCP, len);
+}
+
+/*
+ * jif_rx_csum_ok():
+ *
+ * lwIP leaves checking the IP and TCP checksums of incoming packets to
+ * us too (see CHECKSUM_CHECK_* in lwipopts.h).  Check in software the
+ * ones that pkt->jp_csum says the e1000 didn't.  Returns 1 if they are
+ * good or there is nothing to check, 0 if the packet should be dropped.
+ * Malformed headers are left for lwIP to drop.
+ *
+ */
+static int
+jif_rx_csum_ok(struct jif_pkt *pkt)
+{
+    struct eth_hdr *ethhdr = (struct eth_hdr *)pkt->jp_data;
+    struct ip_hdr *iphdr = (struct ip_hdr *)(ethhdr + 1);
+    int hlen, len;
+    u32_t acc;
+
+    if (pkt->jp_len < sizeof(*ethhdr) + IP_HLEN ||
+	htons(ethhdr->type) != ETHTYPE_IP)
+	return 1;
+    hlen = IPH_HL(iphdr) * 4;
+    len = ntohs(IPH_LEN(iphdr));
+    if (hlen < IP_HLEN || len < hlen || sizeof(*ethhdr) + len > pkt->jp_len)
+	return 1;
+
+    if (!(pkt->jp_csum.pc_flags & PKTCSUM_IP) && inet_chksum(iphdr, hlen) != 0)
+	return 0;
+    if (IPH_PROTO(iphdr) != IP_PROTO_TCP ||
+	(IPH_OFFSET(iphdr) & htons(IP_MF | IP_OFFMASK)) ||
+	(pkt->jp_csum.pc_flags & PKTCSUM_L4))
+	return 1;
+
+    acc = jif_pseudo_sum(iphdr, IP_PROTO_TCP, len - hlen);
+    acc += (u16_t)~inet_chksum((char *)iphdr + hlen, len - hlen);
+    while (acc >> 16)
+	acc = (acc & 0xffff) + (acc >> 16);
+    return acc == 0xffff;
+}
+
 /*
  * low_level_output():
  *
@@ -96,13 +216,14 @@ low_level_output(struct netif *netif, struct pbuf *p)
 	   time. The size of the data in each pbuf is kept in the ->len
 	   variable. */
 
-	if (txsize + q->len > 2000)
+	if (txsize + q->len > PGSIZE - sizeof(struct jif_pkt))
 	    panic("oversized packet, fragment %d txsize %d\n", q->len, txsize);
 	memcpy(&txbuf[txsize], q->payload, q->len);
 	txsize += q->len;
     }
 
     pkt->jp_len = txsize;
+    jif_tx_csum(pkt);
 
     ipc_send(jif->envid, NSREQ_OUTPUT, (void *)pkt, PTE_P|PTE_W|PTE_U);
     sys_page_unmap(0, (void *)pkt);
@@ -180,6 +301,11 @@ jif_input(struct netif *netif, void *va)
     struct pbuf *p;
 
     jif = netif->state;
+
+    if (!jif_rx_csum_ok((struct jif_pkt *)va)) {
+	LINK_STATS_INC(link.chkerr);
+	return;
+    }
   
     /* move received packet into a new pbuf */
     p = low_level_input(va);
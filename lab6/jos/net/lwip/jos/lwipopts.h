@@ -37,7 +37,17 @@ void *memcpy(void *dst, const void *src, size_t n);
 #define PBUF_POOL_SIZE		512
 #define PBUF_POOL_BUFSIZE	2000
 
+// The e1000 computes and checks IP and TCP checksums; jif.c asks it
+// to, and checks in software what it didn't.  UDP keeps its own, since
+// a fragmented datagram's checksum covers all its fragments.
+#define CHECKSUM_GEN_IP		0
+#define CHECKSUM_GEN_TCP	0
+#define CHECKSUM_CHECK_IP	0
+#define CHECKSUM_CHECK_TCP	0
+
 #define TCP_MSS			1460
+// The e1000 splits segments up to what fits in a jif_pkt page
+#define TCP_TSO_SEG		(2 * TCP_MSS)
 #define TCP_WND			24000
 #define TCP_SND_BUF		(16 * TCP_MSS)
 // lwip prints a warning if TCP_SND_QUEUELEN < (2 * TCP_SND_BUF/TCP_MSS), 
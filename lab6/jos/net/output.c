@@ -1,6 +1,7 @@
 #include "ns.h"
 
-extern union Nsipc nsipcbuf;
+// pages the network server's frames arrive in, a batch at a time
+static union Nsipc txbufs[NET_MAXBATCH] __attribute__((aligned(PGSIZE)));
 
 void
 output(envid_t ns_envid)
@@ -10,21 +11,45 @@ output(envid_t ns_envid)
 	// LAB 6: Your code here:
 	// 	- read a packet from the network server
 	//	- send the packet to the device driver
-  int re;
+  int re, n, i;
 
   envid_t from_env;
   int perm;
   struct jif_pkt *pkt;
+  struct TxSeg segs[NET_MAXBATCH];
 
   while(1){
-    re = ipc_recv(&from_env, &nsipcbuf, &perm);
+    re = ipc_recv(&from_env, &txbufs[0], &perm);
     if(re != NSREQ_OUTPUT){
       continue;
     }
+    // gather whatever else is already waiting to be sent
+    n = 1;
+    while(n < NET_MAXBATCH){
+      re = ipc_recv_timeout(&from_env, &txbufs[n], &perm, 0);
+      if(re < 0){
+        break;
+      }
+      if(re == NSREQ_OUTPUT){
+        n++;
+      }
+    }
     
-    pkt = &(nsipcbuf.pkt);
-    while((sys_transmit_packet(pkt->jp_data, pkt->jp_len)) < 0){
-      sys_yield(); 
+    // the card sends straight out of the pages we received; the
+    // kernel keeps them pinned after the next ipc_recv replaces them
+    for(i = 0; i < n; i++){
+      pkt = &(txbufs[i].pkt);
+      segs[i].ts_va = pkt->jp_data;
+      segs[i].ts_len = pkt->jp_len;
+      segs[i].ts_csum = pkt->jp_csum;
+    }
+    for(i = 0; i < n; i += re){
+      if((re = sys_transmit_packets(&segs[i], n - i)) < 0){
+        panic("output: sys_transmit_packets: %e", re);
+      }
+      if(re == 0){
+        sys_yield(); 
+      }
     }
   
   } 
@@ -0,0 +1,47 @@
+// Stream messages to a child through a shared-memory channel, and check
+// that the child sees them all in order, with few wakeups.
+
+#include <inc/lib.h>
+
+#define RING	((struct ChanRing *) 0xA0000000)
+#define NMSGS	1000
+
+struct Msg {
+	uint32_t seq;
+	char data[28];
+};
+
+void
+umain(int argc, char **argv)
+{
+	struct Msg m;
+	envid_t child;
+	int i, r, nnotify;
+
+	if ((r = chan_create(RING, sizeof(struct Msg))) < 0)
+		panic("chan_create: %e", r);
+
+	if ((child = fork()) < 0)
+		panic("fork: %e", child);
+	if (child == 0) {
+		for (i = 0; i < NMSGS; i++) {
+			if ((r = chan_recv(RING, &m)) < 0)
+				panic("chan_recv: %e", r);
+			if (m.seq != i || strcmp(m.data, "chantest") != 0)
+				panic("message %d out of order (got %d)", i, m.seq);
+		}
+		cprintf("chantest: consumer got all messages\n");
+		return;
+	}
+
+	nnotify = 0;
+	strcpy(m.data, "chantest");
+	for (i = 0; i < NMSGS; i++) {
+		m.seq = i;
+		if ((r = chan_send(RING, &m)) < 0)
+			panic("chan_send: %e", r);
+		nnotify += r;
+	}
+	wait(child);
+	cprintf("chantest: %d messages, %d notifications\n", NMSGS, nnotify);
+}
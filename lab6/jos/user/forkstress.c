@@ -0,0 +1,61 @@
+// Stress the page allocator from several CPUs at once: each of
+// NWORKER environments forks NROUND children in turn, and every child
+// takes copy-on-write faults on NPAGES pages before it exits.
+// Run with CPUS=4 or more.
+
+#include <inc/lib.h>
+
+#define NWORKER	8
+#define NROUND	50
+#define NPAGES	16
+
+static char buf[NPAGES][PGSIZE] __attribute__((aligned(PGSIZE)));
+
+static void
+worker(int id)
+{
+	envid_t child;
+	int i, r;
+
+	for (i = 0; i < NPAGES; i++)
+		buf[i][0] = id;
+
+	for (r = 0; r < NROUND; r++) {
+		if ((child = fork()) < 0)
+			panic("fork: %e", child);
+		if (child == 0) {
+			for (i = 0; i < NPAGES; i++)
+				buf[i][0] = id + r + i;
+			for (i = 0; i < NPAGES; i++)
+				if (buf[i][0] != (char) (id + r + i))
+					panic("child page %d is %d", i, buf[i][0]);
+			exit();
+		}
+		wait(child);
+		for (i = 0; i < NPAGES; i++)
+			if (buf[i][0] != id)
+				panic("worker %d: page %d changed to %d",
+				      id, i, buf[i][0]);
+	}
+	cprintf("forkstress: worker %d done on CPU %d\n",
+		id, thisenv->env_cpunum);
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t workers[NWORKER];
+	int i;
+
+	for (i = 0; i < NWORKER; i++) {
+		if ((workers[i] = fork()) < 0)
+			panic("fork: %e", workers[i]);
+		if (workers[i] == 0) {
+			worker(i);
+			exit();
+		}
+	}
+	for (i = 0; i < NWORKER; i++)
+		wait(workers[i]);
+	cprintf("forkstress: %d forks OK\n", NWORKER * NROUND);
+}
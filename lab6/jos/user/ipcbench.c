@@ -0,0 +1,59 @@
+// Measure IPC round-trip latency between two processes, first with
+// ipc_send/ipc_recv as in pingpong, then with ipc_call/ipc_reply_wait.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NROUNDS 1000
+
+static void
+server(void)
+{
+	envid_t who;
+	uint32_t i, val;
+
+	// send/recv round trips
+	for (i = 0; i < NROUNDS; i++) {
+		val = ipc_recv(&who, 0, 0);
+		ipc_send(who, val + 1, 0, 0);
+	}
+
+	// call/reply round trips
+	val = ipc_recv(&who, 0, 0);
+	while (1)
+		val = ipc_reply_wait(who, val + 1, 0, 0, &who, 0, 0);
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t who;
+	uint32_t i;
+	uint64_t start, sendrecv, call;
+
+	if ((who = fork()) == 0) {
+		server();
+		return;
+	}
+
+	start = read_tsc();
+	for (i = 0; i < NROUNDS; i++) {
+		ipc_send(who, i, 0, 0);
+		if (ipc_recv(0, 0, 0) != i + 1)
+			panic("send/recv: bad reply");
+	}
+	sendrecv = read_tsc() - start;
+
+	start = read_tsc();
+	for (i = 0; i < NROUNDS; i++)
+		if (ipc_call(who, i, 0, 0, 0, 0) != i + 1)
+			panic("call: bad reply");
+	call = read_tsc() - start;
+
+	sys_env_destroy(who);
+
+	cprintf("send/recv round trip: %u cycles\n",
+		(uint32_t) (sendrecv / NROUNDS));
+	cprintf("call/reply round trip: %u cycles\n",
+		(uint32_t) (call / NROUNDS));
+}
@@ -0,0 +1,38 @@
+// Test sys_sleep and ipc_recv_timeout.
+
+#include <inc/lib.h>
+
+void
+umain(int argc, char **argv)
+{
+	unsigned int start, elapsed;
+	envid_t who;
+	int r;
+
+	start = time_msec();
+	sys_sleep(100);
+	elapsed = time_msec() - start;
+	cprintf("slept %u ms\n", elapsed);
+	if (elapsed < 100)
+		panic("sys_sleep(100) returned after %u ms", elapsed);
+
+	if ((r = ipc_recv_timeout(0, 0, 0, 0)) != -E_TIMEOUT)
+		panic("ipc_recv_timeout polling: got %e", r);
+
+	start = time_msec();
+	if ((r = ipc_recv_timeout(0, 0, 0, 50)) != -E_TIMEOUT)
+		panic("ipc_recv_timeout: got %e", r);
+	elapsed = time_msec() - start;
+	if (elapsed < 50)
+		panic("ipc_recv_timeout(50) returned after %u ms", elapsed);
+
+	if ((who = fork()) == 0) {
+		sys_sleep(20);
+		ipc_send(thisenv->env_parent_id, 42, 0, 0);
+		return;
+	}
+	if ((r = ipc_recv_timeout(0, 0, 0, 1000)) != 42)
+		panic("ipc_recv_timeout: got %d, expected 42", r);
+
+	cprintf("sleeptest ok\n");
+}
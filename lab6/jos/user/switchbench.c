@@ -0,0 +1,71 @@
+// Measure the cost of switching between two environments: a parent
+// and child bounce a value back and forth with ipc_send/ipc_recv, first
+// alone and then with a page attached, so that each round trip also
+// walks kernel data structures and page tables.  Each measurement is
+// the best of NTRIALS runs, to keep noise from the host out of the
+// comparison.  Run with CPUS=1, so that every round trip is two
+// switches on the same CPU, and compare
+//	make CPUS=1 run-switchbench-nox
+//	make CPUS=1 DEFS=-DPAGE_GLOBAL=0 run-switchbench-nox
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NROUNDS 1000
+#define NTRIALS 5
+
+static char buf[PGSIZE] __attribute__((aligned(PGSIZE)));
+
+static void
+partner(void)
+{
+	envid_t who;
+	uint32_t val;
+
+	while (1) {
+		val = ipc_recv(&who, buf, 0);
+		ipc_send(who, val + 1, buf, PTE_P | PTE_U | PTE_W);
+	}
+}
+
+// Time NROUNDS round trips with the partner 'who', sending and
+// receiving 'pg' if it is not null.  Returns the cycles per round trip.
+static uint32_t
+roundtrips(envid_t who, void *pg)
+{
+	uint64_t start;
+	uint32_t i;
+
+	start = read_tsc();
+	for (i = 0; i < NROUNDS; i++) {
+		ipc_send(who, i, pg, pg ? PTE_P | PTE_U | PTE_W : 0);
+		if (ipc_recv(0, pg, 0) != i + 1)
+			panic("bad reply");
+	}
+	return (read_tsc() - start) / NROUNDS;
+}
+
+void
+umain(int argc, char **argv)
+{
+	envid_t who;
+	uint32_t t, plain = ~0, page = ~0;
+	int i;
+
+	if ((who = fork()) == 0) {
+		partner();
+		return;
+	}
+
+	for (i = 0; i < NTRIALS; i++) {
+		if ((t = roundtrips(who, 0)) < plain)
+			plain = t;
+		if ((t = roundtrips(who, buf)) < page)
+			page = t;
+	}
+
+	sys_env_destroy(who);
+
+	cprintf("switch round trip: %u cycles\n", plain);
+	cprintf("switch round trip with page: %u cycles\n", page);
+}
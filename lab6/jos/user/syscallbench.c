@@ -0,0 +1,42 @@
+// Measure system call latency through the sysenter fast path used by
+// sys_getenvid and through the int $T_SYSCALL trap.
+
+#include <inc/x86.h>
+#include <inc/lib.h>
+
+#define NCALLS 10000
+
+static envid_t
+getenvid_int(void)
+{
+	envid_t ret;
+
+	asm volatile("int %1"
+		     : "=a" (ret)
+		     : "i" (T_SYSCALL), "a" (SYS_getenvid)
+		     : "cc", "memory");
+	return ret;
+}
+
+void
+umain(int argc, char **argv)
+{
+	uint64_t start, fast, slow;
+	int i;
+
+	if (sys_getenvid() != getenvid_int())
+		panic("sysenter and int disagree on our envid");
+
+	start = read_tsc();
+	for (i = 0; i < NCALLS; i++)
+		sys_getenvid();
+	fast = read_tsc() - start;
+
+	start = read_tsc();
+	for (i = 0; i < NCALLS; i++)
+		getenvid_int();
+	slow = read_tsc() - start;
+
+	cprintf("sysenter getenvid: %u cycles\n", (uint32_t) (fast / NCALLS));
+	cprintf("int $T_SYSCALL getenvid: %u cycles\n", (uint32_t) (slow / NCALLS));
+}